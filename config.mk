@@ -7,7 +7,7 @@ INC_DIR=$(PWD)
 CC=tcc -Wall -O3 -g -std=c11
 # CC=g++ -Wall -O3 -g -std=c++11
 CFLAGS=-I$(INC_DIR)
-LIBS=-L$(BLD_DIR) -lm
+LIBS=-L$(BLD_DIR) -lm -lpthread
 
 # COMPILE AND LINKER ALIASES
 COMPILE_OBJ = \
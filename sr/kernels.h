@@ -0,0 +1,359 @@
+/**
+ * SIMD row kernels.
+ *
+ * This file is a template, `sr.h` includes it once per instruction set with
+ * the following defined:
+ *
+ *   KERNEL_ISA    Suffix of the generated functions, e.g. avx2
+ *   KERNEL_WIDTH  Number of doubles per vector
+ *
+ * and with the matching `#pragma GCC target` in effect. Defining
+ * KERNEL_LIBM_LOG as well keeps the libm loops for log and pow; without
+ * 64-bit integer compares (SSE2) the vector log is slower than glibc's.
+ *
+ * The kernels are written with GCC vector extensions so the same code is
+ * compiled to SSE2, AVX2 or AVX-512 instructions. Every lane goes through the
+ * same sequence of IEEE operations (no FMA contraction), so results are bit
+ * identical across instruction sets and independent of where a row falls in
+ * a vector.
+ *
+ * Accuracy of the approximations against glibc's libm, measured over the
+ * input ranges exercised by `test_kernels_accuracy`:
+ *
+ *   exp  <= 1 ulp over [-745, 709.7], overflows to inf and underflows to 0
+ *   log  <= 1 ulp over (0, inf), log(0) = -inf, log(x < 0) = NaN
+ *   sin  <= 2 ulp over |x| <= 823549.6, larger |x| falls back to libm
+ *   cos  <= 2 ulp over |x| <= 823549.6, larger |x| falls back to libm
+ *   pow  computed as exp(y * log(x)), the error grows with |y * log(x)|:
+ *        <= 3 ulp for |y * log(x)| <= 1, about 1.3 * |y * log(x)| ulp
+ *        otherwise (~800 ulp close to overflow). x <= 0 and non-finite
+ *        operands fall back to libm for that lane.
+ */
+#define KERNEL_CAT_(A, B) A##_##B
+#define KERNEL_CAT(A, B) KERNEL_CAT_(A, B)
+#define KFN(NAME) KERNEL_CAT(NAME, KERNEL_ISA)
+
+#define VD KFN(vd)
+#define VI KFN(vi)
+#define VU KFN(vu)
+#define VDU KFN(vdu)
+#define W KERNEL_WIDTH
+
+typedef double VD __attribute__((vector_size(KERNEL_WIDTH * 8)));
+typedef long long VI __attribute__((vector_size(KERNEL_WIDTH * 8)));
+typedef unsigned long long VU __attribute__((vector_size(KERNEL_WIDTH * 8)));
+typedef double VDU
+    __attribute__((vector_size(KERNEL_WIDTH * 8), aligned(8), may_alias));
+
+/******************************************************************************
+ *                                 HELPERS
+ ******************************************************************************/
+
+static inline VD KFN(set)(const double c) {
+  const VD zero = {0};
+  return zero + c;
+}
+
+static inline VD KFN(blend)(const VI mask, const VD a, const VD b) {
+  return (VD) (((VI) a & mask) | ((VI) b & ~mask));
+}
+
+static inline int KFN(any)(const VI mask) {
+  long long r = 0;
+  for (int i = 0; i < W; i++) {
+    r |= mask[i];
+  }
+  return r != 0;
+}
+
+static inline VD KFN(load)(const double *x, const int n, const double pad) {
+  VD v;
+  for (int i = 0; i < W; i++) {
+    v[i] = (i < n) ? x[i] : pad;
+  }
+  return v;
+}
+
+static inline void KFN(store)(double *z, const VD v, const int n) {
+  for (int i = 0; i < n; i++) {
+    z[i] = v[i];
+  }
+}
+
+/* Round to nearest integer, returned both as double and as int64 */
+static inline VD KFN(round)(const VD x, VI *n) {
+  const double shifter = 6755399441055744.0; /* 0x1.8p52 */
+  const VD k = x + shifter;
+  *n = (VI) k - (VI) KFN(set)(shifter);
+  return k - shifter;
+}
+
+/* Integer (|n| < 2^51) to double */
+static inline VD KFN(to_double)(const VI n) {
+  const double shifter = 6755399441055744.0; /* 0x1.8p52 */
+  return (VD) (n + (VI) KFN(set)(shifter)) - shifter;
+}
+
+/* 2^n for n in [-1022, 1023] */
+static inline VD KFN(pow2)(const VI n) {
+  return (VD) ((n + 1023) << 52);
+}
+
+/******************************************************************************
+ *                               APPROXIMATIONS
+ ******************************************************************************/
+
+static inline VD KFN(exp)(VD x) {
+  const double log2e = 1.44269504088896338700e+00;
+  const double ln2_hi = 6.93147180369123816490e-01;
+  const double ln2_lo = 1.90821492927058770002e-10;
+
+  /* Clamp, values outside still overflow to inf or underflow to 0 */
+  x = KFN(blend)(x > 710.0, KFN(set)(710.0), x);
+  x = KFN(blend)(x < -746.0, KFN(set)(-746.0), x);
+
+  /* x = n * ln2 + r, |r| <= ln2 / 2 */
+  VI n;
+  const VD dn = KFN(round)(x * log2e, &n);
+  const VD r = (x - dn * ln2_hi) - dn * ln2_lo;
+
+  /* exp(r), Taylor series to degree 13 */
+  VD p = r * (1.0 / 6227020800.0) + (1.0 / 479001600.0);
+  p = p * r + (1.0 / 39916800.0);
+  p = p * r + (1.0 / 3628800.0);
+  p = p * r + (1.0 / 362880.0);
+  p = p * r + (1.0 / 40320.0);
+  p = p * r + (1.0 / 5040.0);
+  p = p * r + (1.0 / 720.0);
+  p = p * r + (1.0 / 120.0);
+  p = p * r + (1.0 / 24.0);
+  p = p * r + (1.0 / 6.0);
+  p = p * r + 0.5;
+  p = p * r * r + r;
+  p = p + 1.0;
+
+  /* Scale by 2^n in two steps so n in [-1076, 1024] stays representable.
+   * The split is done in doubles, 64-bit arithmetic shifts need AVX-512. */
+  VI n1;
+  KFN(round)(dn * 0.5, &n1);
+  return p * KFN(pow2)(n1) * KFN(pow2)(n - n1);
+}
+
+static inline VD KFN(log)(const VD x) {
+  const double ln2_hi = 6.93147180369123816490e-01;
+  const double ln2_lo = 1.90821492927058770002e-10;
+  const double Lg1 = 6.666666666666735130e-01;
+  const double Lg2 = 3.999999999940941908e-01;
+  const double Lg3 = 2.857142874366239149e-01;
+  const double Lg4 = 2.222219843214978396e-01;
+  const double Lg5 = 1.818357216161805012e-01;
+  const double Lg6 = 1.531383769920937332e-01;
+  const double Lg7 = 1.479819860511658591e-01;
+
+  /* Scale subnormals into the normal range */
+  const VI subnormal = (x < 2.2250738585072014e-308) & (x > 0.0);
+  const VD xs = KFN(blend)(subnormal, x * 18014398509481984.0, x); /* 2^54 */
+
+  /* x = 2^k * m, sqrt(2) / 2 <= m < sqrt(2) */
+  const VI bits = (VI) xs;
+  VI k = (VI) (((VU) bits >> 52) & 0x7ff) - 1023 - (subnormal & 54);
+  VD m = (VD) ((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+  const VI big = m > 1.41421356237309504880;
+  m = KFN(blend)(big, m * 0.5, m);
+  k = k - big;
+
+  /* log(m) = f - hfsq + s * (hfsq + R), as in fdlibm's e_log.c */
+  const VD f = m - 1.0;
+  const VD hfsq = 0.5 * f * f;
+  const VD s = f / (f + 2.0);
+  const VD z = s * s;
+  const VD w = z * z;
+  const VD t1 = w * (Lg2 + w * (Lg4 + w * Lg6));
+  const VD t2 = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)));
+  const VD R = t2 + t1;
+  const VD dk = KFN(to_double)(k);
+  VD y = dk * ln2_hi - ((hfsq - (s * (hfsq + R) + dk * ln2_lo)) - f);
+
+  /* Special cases */
+  y = KFN(blend)(x == 0.0, KFN(set)(-INFINITY), y);
+  y = KFN(blend)(x == INFINITY, x, y);
+  y = KFN(blend)((x < 0.0) | (x != x), KFN(set)(NAN), y);
+  return y;
+}
+
+/* sin(x) or cos(x) for |x| <= 823549.6, larger |x| is left to the caller */
+static inline VD KFN(trig)(const VD x, const int cosine) {
+  const double two_over_pi = 6.36619772367581382433e-01;
+  const double pio2_1 = 1.57079632673412561417e+00;
+  const double pio2_2 = 6.07710050630396597660e-11;
+  const double pio2_3 = 2.02226624871116645580e-21;
+  const double S1 = -1.66666666666666324348e-01;
+  const double S2 = 8.33333333332248946124e-03;
+  const double S3 = -1.98412698298579493134e-04;
+  const double S4 = 2.75573137070700676789e-06;
+  const double S5 = -2.50507602534068634195e-08;
+  const double S6 = 1.58969099521155010221e-10;
+  const double C1 = 4.16666666666666019037e-02;
+  const double C2 = -1.38888888888741095749e-03;
+  const double C3 = 2.48015872894767294178e-05;
+  const double C4 = -2.75573143513906633035e-07;
+  const double C5 = 2.08757232129817482790e-09;
+  const double C6 = -1.13596475577881948265e-11;
+
+  /* x = q * pi / 2 + r, |r| <= pi / 4, Cody-Waite reduction */
+  VI q;
+  const VD dq = KFN(round)(x * two_over_pi, &q);
+  const VD r = ((x - dq * pio2_1) - dq * pio2_2) - dq * pio2_3;
+
+  /* Kernels on [-pi / 4, pi / 4], coefficients from fdlibm's k_sin/k_cos */
+  const VD z = r * r;
+  const VD ps = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+  const VD sin_r = r + (z * r) * (S1 + z * ps);
+  const VD pc = C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6))));
+  const VD cos_r = (1.0 - 0.5 * z) + (z * z) * pc;
+
+  /* cos(x) = sin(x + pi / 2), quadrant picks the kernel and the sign */
+  q = q + cosine;
+  VD y = KFN(blend)((q & 1) != 0, cos_r, sin_r);
+  return (VD) ((VI) y ^ ((q & 2) << 62));
+}
+
+/******************************************************************************
+ *                                  KERNELS
+ ******************************************************************************/
+
+#define KERNEL_SIN_MAX 823549.6
+
+static inline VD KFN(sin)(const VD x) {
+  VD y = KFN(trig)(x, 0);
+  const VI large = ~((x <= KERNEL_SIN_MAX) & (x >= -KERNEL_SIN_MAX));
+  if (KFN(any)(large)) {
+    for (int i = 0; i < W; i++) {
+      y[i] = (large[i]) ? sin(x[i]) : y[i];
+    }
+  }
+  return y;
+}
+
+static inline VD KFN(cos)(const VD x) {
+  VD y = KFN(trig)(x, 1);
+  const VI large = ~((x <= KERNEL_SIN_MAX) & (x >= -KERNEL_SIN_MAX));
+  if (KFN(any)(large)) {
+    for (int i = 0; i < W; i++) {
+      y[i] = (large[i]) ? cos(x[i]) : y[i];
+    }
+  }
+  return y;
+}
+
+static inline VD KFN(pow)(const VD x, const VD y) {
+  VD z = KFN(exp)(y * KFN(log)(x));
+
+  /* x <= 0, inf and NaN operands are left to libm */
+  const VI finite = (x - x == 0.0) & (y - y == 0.0);
+  const VI fallback = ~((x > 0.0) & finite);
+  if (KFN(any)(fallback)) {
+    for (int i = 0; i < W; i++) {
+      z[i] = (fallback[i]) ? pow(x[i], y[i]) : z[i];
+    }
+  }
+  return z;
+}
+
+#define KERNEL_UNARY(NAME, EXPR) \
+  static void KFN(NAME##_vv)(const double *x, const double *y, double *z, const int n) { \
+    int i = 0; \
+    for (; i + W <= n; i += W) { \
+      const VD a = *(const VDU *) (x + i); \
+      *(VDU *) (z + i) = EXPR; \
+    } \
+    if (i < n) { \
+      const VD a = KFN(load)(x + i, n - i, 1.0); \
+      KFN(store)(z + i, EXPR, n - i); \
+    } \
+  }
+
+#define KERNEL_BINARY(NAME, EXPR) \
+  static void KFN(NAME##_vv)(const double *x, const double *y, double *z, const int n) { \
+    int i = 0; \
+    for (; i + W <= n; i += W) { \
+      const VD a = *(const VDU *) (x + i); \
+      const VD b = *(const VDU *) (y + i); \
+      *(VDU *) (z + i) = EXPR; \
+    } \
+    if (i < n) { \
+      const VD a = KFN(load)(x + i, n - i, 1.0); \
+      const VD b = KFN(load)(y + i, n - i, 1.0); \
+      KFN(store)(z + i, EXPR, n - i); \
+    } \
+  } \
+  static void KFN(NAME##_vs)(const double *x, const double y, double *z, const int n) { \
+    const VD b = KFN(set)(y); \
+    int i = 0; \
+    for (; i + W <= n; i += W) { \
+      const VD a = *(const VDU *) (x + i); \
+      *(VDU *) (z + i) = EXPR; \
+    } \
+    if (i < n) { \
+      const VD a = KFN(load)(x + i, n - i, 1.0); \
+      KFN(store)(z + i, EXPR, n - i); \
+    } \
+  } \
+  static void KFN(NAME##_sv)(const double x, const double *y, double *z, const int n) { \
+    const VD a = KFN(set)(x); \
+    int i = 0; \
+    for (; i + W <= n; i += W) { \
+      const VD b = *(const VDU *) (y + i); \
+      *(VDU *) (z + i) = EXPR; \
+    } \
+    if (i < n) { \
+      const VD b = KFN(load)(y + i, n - i, 1.0); \
+      KFN(store)(z + i, EXPR, n - i); \
+    } \
+  }
+
+KERNEL_BINARY(kernel_add, a + b)
+KERNEL_BINARY(kernel_sub, a - b)
+KERNEL_BINARY(kernel_mul, a * b)
+KERNEL_BINARY(kernel_div, a / b)
+KERNEL_UNARY(kernel_exp, KFN(exp)(a))
+#ifndef KERNEL_LIBM_LOG
+KERNEL_BINARY(kernel_pow, KFN(pow)(a, b))
+KERNEL_UNARY(kernel_log, KFN(log)(a))
+#endif
+KERNEL_UNARY(kernel_sin, KFN(sin)(a))
+KERNEL_UNARY(kernel_cos, KFN(cos)(a))
+
+/* Kernels indexed by function type, scalar folds are shared with libm */
+static const kernel_t KFN(kernels)[9] = {
+  {kernel_add_ss, KFN(kernel_add_vv), KFN(kernel_add_vs), KFN(kernel_add_sv)},
+  {kernel_sub_ss, KFN(kernel_sub_vv), KFN(kernel_sub_vs), KFN(kernel_sub_sv)},
+  {kernel_mul_ss, KFN(kernel_mul_vv), KFN(kernel_mul_vs), KFN(kernel_mul_sv)},
+  {kernel_div_ss, KFN(kernel_div_vv), KFN(kernel_div_vs), KFN(kernel_div_sv)},
+#ifdef KERNEL_LIBM_LOG
+  {kernel_pow_ss, kernel_pow_vv, kernel_pow_vs, kernel_pow_sv},
+  {kernel_exp_ss, KFN(kernel_exp_vv), NULL, NULL},
+  {kernel_log_ss, kernel_log_vv, NULL, NULL},
+#else
+  {kernel_pow_ss, KFN(kernel_pow_vv), KFN(kernel_pow_vs), KFN(kernel_pow_sv)},
+  {kernel_exp_ss, KFN(kernel_exp_vv), NULL, NULL},
+  {kernel_log_ss, KFN(kernel_log_vv), NULL, NULL},
+#endif
+  {kernel_sin_ss, KFN(kernel_sin_vv), NULL, NULL},
+  {kernel_cos_ss, KFN(kernel_cos_vv), NULL, NULL}
+};
+
+#undef KERNEL_SIN_MAX
+#undef KERNEL_UNARY
+#undef KERNEL_BINARY
+#undef W
+#undef VDU
+#undef VU
+#undef VI
+#undef VD
+#undef KFN
+#undef KERNEL_CAT
+#undef KERNEL_CAT_
+#undef KERNEL_WIDTH
+#undef KERNEL_ISA
+#undef KERNEL_LIBM_LOG
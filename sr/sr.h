@@ -1,21 +1,36 @@
 #ifndef SR_H
 #define SR_H
 
+/* CPU affinity, huge pages and NUMA need the GNU extensions of libc. Files
+ * that include a libc header before sr.h must define it themselves. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
 
 /* PARAMETERS */
-#define MAX_ARITY 10
+#define MAX_ARITY 2 /* Functions take one or two arguments */
 #define MAX_TREE_SIZE 500
-
-/* #include <iostream> */
-/* #include <random> */
-/* std::random_device device; */
-/* std::mt19937 mt_generator(device()); */
+#define MAX_INPUTS 100
 
 /******************************************************************************
  *                                COMMON
@@ -35,24 +50,122 @@
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
-int randi(int ub, int lb) { return rand() % lb + ub; }
+/**
+ * Random number generator, xoshiro256** by Blackman and Vigna. The state is
+ * passed explicitly instead of hidden in rand(), so runs are reproducible
+ * and every thread or island can own an independent stream: seed one
+ * generator and derive the others with rng_split().
+ */
+typedef struct rng_t {
+  uint64_t s[4];
+} rng_t;
+
+static inline uint64_t rng_rotl(const uint64_t x, const int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/* Seed `rng`, the state is expanded from `seed` with splitmix64 */
+void rng_seed(rng_t *rng, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    seed += 0x9e3779b97f4a7c15ULL;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    rng->s[i] = z ^ (z >> 31);
+  }
+}
+
+uint64_t rng_next(rng_t *rng) {
+  uint64_t *s = rng->s;
+  const uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 45);
+
+  return result;
+}
+
+/* Advance `rng` by 2^128 draws */
+void rng_jump(rng_t *rng) {
+  static const uint64_t jump[4] = {0x180ec6d33cfd0abaULL,
+                                   0xd5a61266f0c9392cULL,
+                                   0xa9582618e03fc9aaULL,
+                                   0x39abdc4529b1661cULL};
+  uint64_t s[4] = {0};
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 64; b++) {
+      if (jump[i] & (1ULL << b)) {
+        for (int k = 0; k < 4; k++) {
+          s[k] ^= rng->s[k];
+        }
+      }
+      rng_next(rng);
+    }
+  }
+  memcpy(rng->s, s, sizeof(s));
+}
+
+/**
+ * Returns a generator for a new stream and moves `rng` 2^128 draws ahead, so
+ * the streams of successive splits never overlap.
+ */
+rng_t rng_split(rng_t *rng) {
+  rng_t stream = *rng;
+  rng_jump(rng);
+  return stream;
+}
+
+/* Uniform integer in [lb, ub] */
+int randi(rng_t *rng, const int lb, const int ub) {
+  assert(lb <= ub);
+  const uint64_t range = (uint64_t) ((int64_t) ub - lb) + 1;
+  const uint64_t limit = UINT64_MAX - UINT64_MAX % range;
+
+  /* Reject the draws that would bias the modulo */
+  uint64_t x = rng_next(rng);
+  while (x >= limit) {
+    x = rng_next(rng);
+  }
+
+  return (int) (lb + (int64_t) (x % range));
+}
+
+/* Uniform double in [lb, ub) */
+double randf(rng_t *rng, const double lb, const double ub) {
+  const double random = (rng_next(rng) >> 11) * 0x1.0p-53;
+  return lb + random * (ub - lb);
+}
 
-double randf(double lb, double ub) {
-  double random = ((double) rand()) / (double) RAND_MAX;
-  double diff = ub - lb;
-  double r = random * diff;
-  return lb + r;
+/* Fill `x` with `n` uniform integers in [lb, ub] */
+void randi_bulk(rng_t *rng, int *x, const int n, const int lb, const int ub) {
+  for (int i = 0; i < n; i++) {
+    x[i] = randi(rng, lb, ub);
+  }
 }
 
-/* int randi(int lb, int ub) { */
-/* 	std::uniform_int_distribution<int> mt_rand(lb, ub); */
-/* 	return mt_rand(mt_generator); */
-/* } */
+/* Fill `x` with `n` uniform doubles in [lb, ub) */
+void randf_bulk(rng_t *rng, double *x, const int n, const double lb, const double ub) {
+  /* Local copy of the state lets the compiler keep it in registers */
+  rng_t r = *rng;
+  const double scale = (ub - lb) * 0x1.0p-53;
+  for (int i = 0; i < n; i++) {
+    x[i] = lb + (rng_next(&r) >> 11) * scale;
+  }
+  *rng = r;
+}
 
-/* double randf(double lb, double ub) { */
-/* 	std::uniform_real_distribution<double> mt_rand(lb, ub); */
-/* 	return mt_rand(mt_generator); */
-/* } */
+/* Mix value `v` into hash `h` (splitmix64 finalizer) */
+uint64_t hash_mix(uint64_t h, const uint64_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
 
 int fltcmp(const double f1, const double f2) {
   if (fabs(f1 - f2) <= 0.0001) {
@@ -70,28 +183,212 @@ char *malloc_string(const char *s) {
   return retval;
 }
 
+/******************************************************************************
+ *                                  MEMORY
+ ******************************************************************************/
+
+/* Platforms without MAP_HUGETLB or MADV_HUGEPAGE fall back to the heap */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define MEM_ALIGN 64
+
+/* Regions of at least this size try huge pages */
+#define MEM_HUGE_MIN (HUGE_PAGE_SIZE / 2)
+
+/* Backing of a region */
+#define MEM_HEAP 0    /* aligned_alloc() */
+#define MEM_HUGETLB 1 /* Explicit huge pages, mmap() with MAP_HUGETLB */
+#define MEM_THP 2     /* Huge page aligned mmap() advised as transparent huge pages */
+
+/* Large region allocated with mem_alloc() */
+typedef struct mem_region_t {
+  void *addr;
+  size_t size;   /* Bytes requested */
+  size_t mapped; /* Bytes mapped, 0 for MEM_HEAP */
+  int backing;
+  const char *label;
+  struct mem_region_t *next;
+} mem_region_t;
+
+static mem_region_t *mem_regions = NULL;
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *mem_backing_name(const int backing) {
+  switch (backing) {
+    case MEM_HUGETLB: return "hugetlb";
+    case MEM_THP: return "thp";
+    default: return "heap";
+  }
+}
+
+/* Whether transparent huge pages can be used at all */
+static int mem_thp_enabled() {
+#ifndef MADV_HUGEPAGE
+  return 0;
+#else
+  static int enabled = -1;
+  if (enabled == -1) {
+    char mode[128] = {0};
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (fp) {
+      if (fgets(mode, 128, fp) == NULL) {
+        mode[0] = '\0';
+      }
+      fclose(fp);
+    }
+    enabled = (fp != NULL && strstr(mode, "[never]") == NULL);
+  }
+  return enabled;
+#endif
+}
+
+/* Map `size` bytes on a huge page boundary advised as transparent huge pages */
+static void *mem_map_thp(const size_t size) {
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  char *p = (char *) mmap(NULL, size + HUGE_PAGE_SIZE, prot, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+
+  /* Trim to a huge page boundary */
+  const size_t head = (HUGE_PAGE_SIZE - (uintptr_t) p % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+  if (head > 0) {
+    munmap(p, head);
+  }
+  munmap(p + head + size, HUGE_PAGE_SIZE - head);
+  p += head;
+
+#ifdef MADV_HUGEPAGE
+  if (madvise(p, size, MADV_HUGEPAGE) != 0) {
+    munmap(p, size);
+    return NULL;
+  }
+#endif
+  return p;
+}
+
+/**
+ * Allocate `size` bytes aligned to a cache line. Regions of MEM_HUGE_MIN
+ * bytes or more are backed by explicit huge pages if any are reserved, else
+ * by transparent huge pages, else by the heap, and are recorded under
+ * `label` for mem_print(). Pages are not touched, so they are placed on the
+ * NUMA node of the thread that first writes them. Free with mem_free().
+ */
+void *mem_alloc(const size_t size, const char *label) {
+  if (size < MEM_HUGE_MIN) {
+    return aligned_alloc(MEM_ALIGN, (MAX(size, 1) + MEM_ALIGN - 1) / MEM_ALIGN * MEM_ALIGN);
+  }
+
+  mem_region_t *r = (mem_region_t *) malloc(sizeof(mem_region_t));
+  r->size = size;
+  r->mapped = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  r->label = label;
+
+  r->addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+  r->addr = mmap(NULL, r->mapped, prot, flags, -1, 0);
+  r->backing = MEM_HUGETLB;
+#endif
+  if (r->addr == MAP_FAILED) {
+    r->addr = (mem_thp_enabled()) ? mem_map_thp(r->mapped) : NULL;
+    r->backing = MEM_THP;
+  }
+  if (r->addr == NULL) {
+    r->mapped = 0;
+    r->addr = aligned_alloc(MEM_ALIGN, (size + MEM_ALIGN - 1) / MEM_ALIGN * MEM_ALIGN);
+    r->backing = MEM_HEAP;
+  }
+  if (r->addr == NULL) {
+    free(r);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&mem_lock);
+  r->next = mem_regions;
+  mem_regions = r;
+  pthread_mutex_unlock(&mem_lock);
+
+  return r->addr;
+}
+
+/* Free memory from mem_alloc(), or from malloc() */
+void mem_free(void *p) {
+  if (p == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&mem_lock);
+  mem_region_t *r = NULL;
+  for (mem_region_t **prev = &mem_regions; *prev; prev = &(*prev)->next) {
+    if ((*prev)->addr == p) {
+      r = *prev;
+      *prev = r->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mem_lock);
+
+  if (r == NULL || r->mapped == 0) {
+    free(p);
+  } else {
+    munmap(r->addr, r->mapped);
+  }
+  free(r);
+}
+
+/* Backing of memory `p` from mem_alloc(), MEM_HEAP for small regions */
+int mem_backing(const void *p) {
+  int backing = MEM_HEAP;
+  pthread_mutex_lock(&mem_lock);
+  for (mem_region_t *r = mem_regions; r; r = r->next) {
+    if (r->addr == p) {
+      backing = r->backing;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mem_lock);
+  return backing;
+}
+
+/* Print the backing of every large region and the total per backing */
+void mem_print() {
+  size_t totals[3] = {0};
+  pthread_mutex_lock(&mem_lock);
+  for (mem_region_t *r = mem_regions; r; r = r->next) {
+    printf("mem.region: %s size=%.1fMB backing=%s\n",
+           r->label, r->size / (1024.0 * 1024.0), mem_backing_name(r->backing));
+    totals[r->backing] += r->size;
+  }
+  pthread_mutex_unlock(&mem_lock);
+  for (int backing = 0; backing < 3; backing++) {
+    printf("mem.%s: %.1fMB\n", mem_backing_name(backing), totals[backing] / (1024.0 * 1024.0));
+  }
+}
+
 /******************************************************************************
  *                                  STACK
  ******************************************************************************/
 
-struct stack_t {
+struct sr_stack_t {
   void *data[MAX_TREE_SIZE];
   int size;
-} typedef stack_t;
+} typedef sr_stack_t;
 
-void stack_setup(stack_t *s) {
+void stack_setup(sr_stack_t *s) {
   for (int i = 0; i < MAX_TREE_SIZE; i++) {
     s->data[i] = NULL;
   }
   s->size = 0.0;
 }
 
-void stack_push(stack_t *s, void *item) {
+void stack_push(sr_stack_t *s, void *item) {
   s->data[s->size] = item;
   s->size++;
 }
 
-void *stack_pop(stack_t *s) {
+void *stack_pop(sr_stack_t *s) {
   s->size--;
   return s->data[s->size];
 }
@@ -200,6 +497,37 @@ void terminal_set_print(const terminal_set_t *ts) {
   printf("\n");
 }
 
+/******************************************************************************
+ *                                  INPUTS
+ ******************************************************************************/
+
+/**
+ * Input names are interned once into a table, nodes and programs refer to an
+ * input by its id. A dataset maps input ids to its columns when it is loaded
+ * (see `dataset_bind()`), so evaluation never compares strings.
+ */
+static char *inputs_table[MAX_INPUTS];
+static int inputs_length = 0;
+
+int input_id(const char *input_name) {
+  for (int i = 0; i < inputs_length; i++) {
+    if (strcmp(inputs_table[i], input_name) == 0) {
+      return i;
+    }
+  }
+
+  if (inputs_length == MAX_INPUTS) {
+    FATAL("Opps! Too many inputs, MAX_INPUTS is %d!", MAX_INPUTS);
+  }
+  inputs_table[inputs_length] = malloc_string(input_name);
+  return inputs_length++;
+}
+
+const char *input_name(const int id) {
+  assert(id >= 0 && id < inputs_length);
+  return inputs_table[id];
+}
+
 /******************************************************************************
  *                                   NODE
  ******************************************************************************/
@@ -213,37 +541,268 @@ void terminal_set_print(const terminal_set_t *ts) {
 #define CONST 1
 #define RCONST 2
 
+/**
+ * Node of a tree variation works on, 48 bytes. Pointers come first and the
+ * small fields are bytes, so there is no padding between them. Trees are
+ * stored packed between variations, see cnode_t.
+ */
 typedef struct node_t {
   /* General */
-  int type;
   struct node_t *parent;
-  int nth_child;
-
-  /* Terminal node specific */
-  int data_type;
-  double value;
-  char *input_name;
-	double *eval_data;
 
   /* Function node specific */
-  int function;
-  int arity;
   struct node_t *children[MAX_ARITY];
+
+  /* Terminal node specific, `data_type` tells which one is set */
+  union {
+    double value;
+    int input;
+    double *eval_data;
+  };
+
+  /* Output on every row of a dataset, kept by evaluate_tree_incremental() */
+  double *output; /* Shared by copies, see node_output_alloc() */
+
+  int8_t type;
+  int8_t nth_child;
+  int8_t data_type;
+  int8_t function;
+  int8_t arity;
+  int8_t output_valid;
 } node_t;
 
+/* Bytes of a node arena slab, one huge page */
+#define NODE_SLAB_SIZE HUGE_PAGE_SIZE
+
+/* Maximum length of a thread's free list, beyond it half spills to the arena */
+#define NODE_CACHE_SIZE 4096
+
+/**
+ * Node arena. Nodes are carved out of slabs from mem_alloc(), so allocating
+ * one is a pointer bump and nodes of a tree sit next to each other. Every
+ * thread bumps through its own slab and keeps the nodes it frees on its own
+ * free list, linked through `parent`, which node_new() reuses first, so
+ * threads copying and deleting thousands of trees per generation never call
+ * malloc() or contend on a lock. A node goes to the free list of the thread
+ * that frees it, whichever thread allocated it. A list longer than
+ * NODE_CACHE_SIZE spills half its nodes to the arena's list, where any
+ * thread refills from, so nodes do not pile up on the threads that delete
+ * more trees than they build. Slabs are only returned by node_arena_reset().
+ */
+typedef struct node_arena_t {
+  void **slabs;
+  int nb_slabs;
+  int max_slabs;
+  node_t *free; /* Nodes spilled or handed back by node_cache_release() */
+  atomic_long epoch;
+  pthread_mutex_t lock;
+} node_arena_t;
+
+static node_arena_t node_arena = {NULL, 0, 0, NULL, 1, PTHREAD_MUTEX_INITIALIZER};
+
+/* Calling thread's free list and unused part of its slab */
+static _Thread_local node_t *node_cache = NULL;
+static _Thread_local int node_cache_length = 0;
+static _Thread_local node_t *node_bump = NULL;
+static _Thread_local node_t *node_bump_end = NULL;
+static _Thread_local long node_epoch = 0;
+
+/* Take up to half a free list of nodes handed back to the arena, or a new slab */
+static void node_arena_refill() {
+  pthread_mutex_lock(&node_arena.lock);
+  if (node_arena.free) {
+    node_t *last = node_arena.free;
+    node_cache_length = 1;
+    while (last->parent && node_cache_length < NODE_CACHE_SIZE / 2) {
+      last = last->parent;
+      node_cache_length++;
+    }
+    node_cache = node_arena.free;
+    node_arena.free = last->parent;
+    last->parent = NULL;
+    pthread_mutex_unlock(&node_arena.lock);
+    return;
+  }
+
+  node_t *slab = (node_t *) mem_alloc(NODE_SLAB_SIZE, "node arena");
+  if (slab == NULL) {
+    FATAL("Failed to allocate node arena slab!");
+  }
+  if (node_arena.nb_slabs == node_arena.max_slabs) {
+    node_arena.max_slabs = MAX(16, node_arena.max_slabs * 2);
+    node_arena.slabs = (void **) realloc(node_arena.slabs, sizeof(void *) * node_arena.max_slabs);
+  }
+  node_arena.slabs[node_arena.nb_slabs++] = slab;
+  pthread_mutex_unlock(&node_arena.lock);
+
+  node_bump = slab;
+  node_bump_end = slab + NODE_SLAB_SIZE / sizeof(node_t);
+}
+
+/* Drop the lists of the calling thread if they went with the slabs of a reset */
+static void node_cache_sync() {
+  const long epoch = atomic_load_explicit(&node_arena.epoch, memory_order_acquire);
+  if (node_epoch != epoch) {
+    node_cache = NULL;
+    node_cache_length = 0;
+    node_bump = NULL;
+    node_bump_end = NULL;
+    node_epoch = epoch;
+  }
+}
+
+static node_t *node_alloc() {
+  node_cache_sync();
+  if (node_cache == NULL && node_bump == node_bump_end) {
+    node_arena_refill();
+  }
+  node_t *n = node_cache;
+  if (n == NULL) {
+    return node_bump++;
+  }
+  node_cache = n->parent;
+  node_cache_length--;
+  return n;
+}
+
+/**
+ * Hand the last `nb_nodes` nodes of the calling thread's free list to the
+ * arena, keeping the most recently freed ones, which are likely in cache.
+ */
+static void node_cache_spill(const int nb_nodes) {
+  node_cache_length -= nb_nodes;
+  node_t *first = node_cache;
+  if (node_cache_length == 0) {
+    node_cache = NULL;
+  } else {
+    node_t *cut = node_cache;
+    for (int i = 1; i < node_cache_length; i++) {
+      cut = cut->parent;
+    }
+    first = cut->parent;
+    cut->parent = NULL;
+  }
+  node_t *last = first;
+  while (last->parent) {
+    last = last->parent;
+  }
+
+  pthread_mutex_lock(&node_arena.lock);
+  last->parent = node_arena.free;
+  node_arena.free = first;
+  pthread_mutex_unlock(&node_arena.lock);
+}
+
+static void node_free(node_t *n) {
+  node_cache_sync();
+  n->parent = node_cache;
+  node_cache = n;
+  node_cache_length++;
+  if (node_cache_length > NODE_CACHE_SIZE) {
+    node_cache_spill(node_cache_length / 2);
+  }
+}
+
+/**
+ * Hand the free nodes and the unused part of the slab of the calling thread
+ * back to the arena for other threads, e.g. before it exits.
+ */
+void node_cache_release() {
+  node_cache_sync();
+  while (node_bump < node_bump_end) {
+    node_free(node_bump++);
+  }
+  node_bump = NULL;
+  node_bump_end = NULL;
+  if (node_cache_length > 0) {
+    node_cache_spill(node_cache_length);
+  }
+}
+
+/**
+ * Free every slab at once, e.g. between runs. No node may be in use and no
+ * other thread may be allocating nodes.
+ */
+void node_arena_reset() {
+  pthread_mutex_lock(&node_arena.lock);
+  for (int i = 0; i < node_arena.nb_slabs; i++) {
+    mem_free(node_arena.slabs[i]);
+  }
+  free(node_arena.slabs);
+  node_arena.slabs = NULL;
+  node_arena.nb_slabs = 0;
+  node_arena.max_slabs = 0;
+  node_arena.free = NULL;
+  atomic_fetch_add_explicit(&node_arena.epoch, 1, memory_order_release);
+  pthread_mutex_unlock(&node_arena.lock);
+}
+
+void node_arena_print() {
+  pthread_mutex_lock(&node_arena.lock);
+  const size_t bytes = (size_t) node_arena.nb_slabs * NODE_SLAB_SIZE;
+  printf("nodes.slabs: %d\n", node_arena.nb_slabs);
+  printf("nodes.capacity: %zu\n", bytes / sizeof(node_t));
+  printf("nodes.bytes: %.1fMB\n", bytes / (1024.0 * 1024.0));
+  if (node_arena.nb_slabs) {
+    printf("nodes.backing: %s\n", mem_backing_name(mem_backing(node_arena.slabs[0])));
+  }
+  pthread_mutex_unlock(&node_arena.lock);
+}
+
+/**
+ * Node outputs are preceded by a reference count: copies of a tree share
+ * the outputs of its nodes and evaluation writes a stale output in place
+ * only if no other node holds it.
+ */
+typedef struct node_output_header_t {
+  _Alignas(16) atomic_int refs;
+  int rows;
+} node_output_header_t;
+
+#define NODE_OUTPUT_HEADER(OUTPUT) ((node_output_header_t *) (OUTPUT) - 1)
+
+double *node_output_alloc(const int rows) {
+  node_output_header_t *h = (node_output_header_t *) malloc(sizeof(node_output_header_t) + sizeof(double) * rows);
+  atomic_init(&h->refs, 1);
+  h->rows = rows;
+  return (double *) (h + 1);
+}
+
+double *node_output_retain(double *output) {
+  atomic_fetch_add_explicit(&NODE_OUTPUT_HEADER(output)->refs, 1, memory_order_relaxed);
+  return output;
+}
+
+/* Drop a reference to `output`, freeing it with the last one */
+void node_output_release(double *output) {
+  if (output == NULL) {
+    return;
+  }
+  node_output_header_t *h = NODE_OUTPUT_HEADER(output);
+  if (atomic_fetch_sub_explicit(&h->refs, 1, memory_order_acq_rel) == 1) {
+    free(h);
+  }
+}
+
+static int node_output_shared(const double *output) {
+  const node_output_header_t *h = (const node_output_header_t *) output - 1;
+  return atomic_load_explicit(&h->refs, memory_order_acquire) > 1;
+}
+
 node_t *node_new() {
-  node_t *n = (node_t *) malloc(sizeof(node_t));
+  node_t *n = node_alloc();
 
   /* General */
   n->type = -1;
   n->parent = NULL;
   n->nth_child = -1;
 
+  n->output = NULL;
+  n->output_valid = 0;
+
   /* Terminal node specific */
   n->data_type = -1;
   n->value = 0.0;
-  n->input_name = NULL;
-  n->eval_data = NULL;
 
   /* Function node specific */
   n->function = -1;
@@ -261,13 +820,10 @@ static void node_delete_traverse(node_t *n) {
 	}
 
   if (n->type == TERM_NODE) {
-		if (n->input_name != NULL) {
-			free(n->input_name);
-		}
-		if (n->eval_data != NULL) {
+		if (n->data_type == EVAL) {
 			free(n->eval_data);
 		}
-    free(n);
+    node_free(n);
     n = NULL;
     return;
   }
@@ -275,7 +831,8 @@ static void node_delete_traverse(node_t *n) {
   for (int i = 0; i < n->arity; i++) {
 		node_delete_traverse(n->children[i]);
   }
-  free(n);
+  node_output_release(n->output);
+  node_free(n);
   n = NULL;
 }
 
@@ -289,15 +846,17 @@ static void node_copy_traverse(const node_t *src, node_t *des) {
   des->type = src->type;
   /* des->parent = src->parent; */
   /* des->nth_child = src->nth_child; */
+  if (src->output_valid) {
+    des->output = node_output_retain(src->output);
+    des->output_valid = 1;
+  }
 
   /* Terminal node specific */
   des->data_type = src->data_type;
-  des->value = src->value;
-  if (src->input_name) {
-    des->input_name = malloc_string(src->input_name);
-  }
-  if (src->eval_data) {
-    des->eval_data = src->eval_data;
+  switch (src->data_type) {
+  case INPUT: des->input = src->input; break;
+  case CONST: des->value = src->value; break;
+  case EVAL: des->eval_data = src->eval_data; break;
   }
 
   /* Function node specific */
@@ -319,6 +878,16 @@ node_t *node_copy(const node_t *src) {
   return des;
 }
 
+/**
+ * Mark the outputs of node `n` and of its ancestors stale after `n` or its
+ * children changed, the outputs of the other nodes stay valid.
+ */
+void node_invalidate(node_t *n) {
+  for (; n != NULL; n = n->parent) {
+    n->output_valid = 0;
+  }
+}
+
 void node_print(const node_t *n) {
   assert(n != NULL);
 
@@ -347,7 +916,7 @@ void node_print(const node_t *n) {
     switch (n->data_type) {
     case INPUT:
       printf("input\t");
-      printf("input_name: %s\n", n->input_name);
+      printf("input_name: %s\n", input_name(n->input));
       break;
     case CONST:
       printf("const\t");
@@ -380,7 +949,7 @@ char *node_string(const node_t *n) {
     break;
   case TERM_NODE:
     switch (n->data_type) {
-    case INPUT: strcpy(buf, n->input_name); break;
+    case INPUT: strcpy(buf, input_name(n->input)); break;
     case CONST: snprintf(buf, 100, "%.4e", n->value); break;
     }
     break;
@@ -397,11 +966,11 @@ node_t *node_new_func(const int function, const int arity) {
 	return n;
 }
 
-node_t *node_new_input(char *input_name) {
+node_t *node_new_input(const char *input_name) {
   node_t *n = node_new();
   n->type = TERM_NODE;
   n->data_type = INPUT;
-  n->input_name = malloc_string(input_name);
+  n->input = input_id(input_name);
 	return n;
 }
 
@@ -421,17 +990,17 @@ node_t *node_new_eval(size_t size) {
 	return n;
 }
 
-node_t *random_func(const function_set_t *fs) {
+node_t *random_func(rng_t *rng, const function_set_t *fs) {
   assert(fs != NULL);
   assert(fs->length > 1);
-  const int idx = randi(0, fs->length - 1);
+  const int idx = randi(rng, 0, fs->length - 1);
   return node_new_func(fs->funcs[idx], fs->arity[idx]);
 }
 
-node_t *random_term(const terminal_set_t *ts) {
+node_t *random_term(rng_t *rng, const terminal_set_t *ts) {
   assert(ts != NULL);
   assert(ts->length > 1);
-  const int idx = randi(0, ts->length - 1);
+  const int idx = randi(rng, 0, ts->length - 1);
   const terminal_t *term = &ts->terms[idx];
 
   switch (term->type) {
@@ -442,7 +1011,7 @@ node_t *random_term(const terminal_set_t *ts) {
     return node_new_const(term->val);
     break;
   case RCONST:
-    return node_new_const(randf(term->range[0], term->range[1]));
+    return node_new_const(randf(rng, term->range[0], term->range[1]));
     break;
   }
 
@@ -450,110 +1019,835 @@ node_t *random_term(const terminal_set_t *ts) {
 }
 
 /******************************************************************************
- *                                   TREE
+ *                                 PROGRAM
  ******************************************************************************/
 
-typedef struct tree_t {
-  node_t *root;
-  int size;
-  int depth;
-
-  double error;
-  double score;
-} tree_t;
-
-tree_t *tree_new() {
-  tree_t *t = (tree_t *) malloc(sizeof(tree_t));
-  t->root = NULL;
-  t->size = 0;
-  t->depth = 0;
+/* Program Opcodes (function opcodes are the function types ADD - COS) */
+#define OP_INPUT 9
+#define OP_CONST 10
+
+/**
+ * Compact node, 16 bytes instead of the 48 of a node_t. A packed tree is an
+ * array of them in prefix order, every function followed by its children,
+ * so no child or parent pointers are needed. Opcodes are those of instr_t.
+ *
+ * The subtree of node `i` spans nodes [i, i + len) and is `height` levels
+ * deep. Both are relative to the node, so they stay valid when a subtree
+ * moves and replacing a subtree only updates its ancestors, see
+ * tree_splice(). A packed tree holds at most CNODE_MAX_SIZE nodes.
+ */
+typedef struct cnode_t {
+  uint8_t op;      /* Function, OP_INPUT or OP_CONST */
+  uint8_t arity;   /* 0 for terminals */
+  uint16_t len;    /* Nodes in the subtree */
+  uint16_t height; /* Levels below the node, 0 for terminals */
+  union {
+    int32_t input; /* Input id of OP_INPUT */
+    double value;  /* Value of OP_CONST */
+  };
+} cnode_t;
+
+#define CNODE_MAX_SIZE UINT16_MAX
+
+/**
+ * Packed nodes are immutable once shared: the array is preceded by a
+ * reference count, so copies of a packed tree share it and a variation
+ * copies it before changing it, see tree_own().
+ */
+typedef struct cnode_header_t {
+  _Alignas(16) atomic_int refs;
+  int capacity; /* Nodes the array can hold */
+} cnode_header_t;
+
+#define CNODE_HEADER(NODES) ((cnode_header_t *) (NODES) - 1)
+
+cnode_t *cnode_alloc(const int size) {
+  cnode_header_t *h = (cnode_header_t *) malloc(sizeof(cnode_header_t) + sizeof(cnode_t) * size);
+  atomic_init(&h->refs, 1);
+  h->capacity = size;
+  return (cnode_t *) (h + 1);
+}
 
-  t->error = 0.0;
-  t->score = 0.0;
-  return t;
+cnode_t *cnode_retain(cnode_t *nodes) {
+  atomic_fetch_add_explicit(&CNODE_HEADER(nodes)->refs, 1, memory_order_relaxed);
+  return nodes;
 }
 
-void tree_delete(tree_t *t) {
-  if (t->root != NULL) {
-    node_delete(t->root);
+/* Drop a reference to `nodes`, freeing them with the last one */
+void cnode_release(cnode_t *nodes) {
+  if (nodes == NULL) {
+    return;
+  }
+  cnode_header_t *h = CNODE_HEADER(nodes);
+  if (atomic_fetch_sub_explicit(&h->refs, 1, memory_order_acq_rel) == 1) {
+    free(h);
   }
-  free(t);
 }
 
-tree_t *tree_copy(const tree_t *src) {
-  tree_t *t = tree_new();
-
-  t->root = node_copy(src->root);
-  t->size = src->size;
-  t->depth = src->depth;
+/* Make room for `size` nodes in unshared `nodes`, arrays never shrink */
+static cnode_t *cnode_reserve(cnode_t *nodes, const int size) {
+  assert(atomic_load(&CNODE_HEADER(nodes)->refs) == 1);
+  cnode_header_t *h = CNODE_HEADER(nodes);
+  if (size <= h->capacity) {
+    return nodes;
+  }
+  h = (cnode_header_t *) realloc(h, sizeof(cnode_header_t) + sizeof(cnode_t) * size);
+  h->capacity = size;
+  return (cnode_t *) (h + 1);
+}
 
-  t->error = src->error;
-  t->score = src->score;
+/* Calling thread's scratch nodes, see cnode_scratch() */
+static _Thread_local cnode_t *cnode_scratch_nodes = NULL;
+static _Thread_local int cnode_scratch_size = 0;
+
+/**
+ * Scratch array of at least `size` nodes for the calling thread, e.g. for a
+ * subtree a crossover moves. Valid until the next call, the array only grows
+ * and is kept until cnode_scratch_release().
+ */
+static cnode_t *cnode_scratch(const int size) {
+  if (size > cnode_scratch_size) {
+    free(cnode_scratch_nodes);
+    cnode_scratch_size = MAX(size, 2 * cnode_scratch_size);
+    cnode_scratch_nodes = (cnode_t *) malloc(sizeof(cnode_t) * cnode_scratch_size);
+  }
+  return cnode_scratch_nodes;
+}
 
-  return t;
+/* Free the scratch nodes of the calling thread, e.g. before it exits */
+void cnode_scratch_release() {
+  free(cnode_scratch_nodes);
+  cnode_scratch_nodes = NULL;
+  cnode_scratch_size = 0;
 }
 
-static void tree_string_traverse(const node_t *n, char *buf, size_t buf_len) {
-  if (n->type == TERM_NODE) {
-    char *s = node_string(n);
-    sprintf(buf + buf_len, "%s ", s);
-    free(s);
-    return;
+/* Height of function node `idx` from the heights of its children */
+static void cnode_height_update(cnode_t *nodes, const int idx) {
+  int height = 0;
+  int child = idx + 1;
+  for (int i = 0; i < nodes[idx].arity; i++) {
+    height = MAX(height, nodes[child].height + 1);
+    child += nodes[child].len;
   }
+  nodes[idx].height = height;
+}
 
-  char *s = node_string(n);
-  sprintf(buf + buf_len, "%s ", s);
-  free(s);
+static void cnode_pack_traverse(const node_t *n, cnode_t *nodes, int *idx) {
+  const int start = *idx;
+  cnode_t *c = &nodes[(*idx)++];
+  memset(c, 0, sizeof(cnode_t));
 
-  for (int i = 0; i < n->arity; i++) {
-    tree_string_traverse(n->children[i], buf, strlen(buf));
+  if (n->type == FUNC_NODE) {
+    c->op = n->function;
+    c->arity = n->arity;
+    for (int i = 0; i < n->arity; i++) {
+      cnode_pack_traverse(n->children[i], nodes, idx);
+    }
+    cnode_height_update(nodes, start);
+  } else if (n->data_type == INPUT) {
+    c->op = OP_INPUT;
+    c->input = n->input;
+  } else if (n->data_type == CONST) {
+    c->op = OP_CONST;
+    c->value = n->value;
+  } else {
+    FATAL("Opps! Invalid terminal type [%d]!", n->data_type);
   }
+  c->len = *idx - start;
 }
 
-char *tree_string(const tree_t *t) {
-  char buf[9046] = {0};
+/* Pack the `size` nodes from `root` into `nodes`, at most CNODE_MAX_SIZE */
+void cnode_pack(const node_t *root, cnode_t *nodes, const int size) {
+  assert(size <= CNODE_MAX_SIZE);
+  int idx = 0;
+  cnode_pack_traverse(root, nodes, &idx);
+  assert(idx == size);
+  (void) size;
+}
 
-  if (t->root) {
-    tree_string_traverse(t->root, buf, 0);
+static node_t *cnode_unpack_traverse(const cnode_t *nodes, int *idx) {
+  const cnode_t *c = &nodes[(*idx)++];
+  node_t *n = node_new();
 
-    /* Remove trailing white space */
-    if (buf[strlen(buf) - 1] == ' ') {
-      buf[strlen(buf) - 1] = '\0';
+  if (c->op == OP_INPUT) {
+    n->type = TERM_NODE;
+    n->data_type = INPUT;
+    n->input = c->input;
+  } else if (c->op == OP_CONST) {
+    n->type = TERM_NODE;
+    n->data_type = CONST;
+    n->value = c->value;
+  } else {
+    n->type = FUNC_NODE;
+    n->function = c->op;
+    n->arity = c->arity;
+    for (int i = 0; i < c->arity; i++) {
+      n->children[i] = cnode_unpack_traverse(nodes, idx);
+      n->children[i]->parent = n;
+      n->children[i]->nth_child = i;
     }
   }
 
-  return malloc_string(buf);
+  return n;
 }
 
-static void tree_print_traverse(const node_t *n) {
-  if (n->type == TERM_NODE) {
-    printf("  ");
-    node_print(n);
-    return;
-  }
+/* Rebuild the node tree of packed nodes `nodes` */
+node_t *cnode_unpack(const cnode_t *nodes) {
+  int idx = 0;
+  return cnode_unpack_traverse(nodes, &idx);
+}
 
-  printf("  ");
-  node_print(n);
-  for (int i = 0; i < n->arity; i++) {
-    tree_print_traverse(n->children[i]);
-  }
+/**
+ * A tree flattened into postfix order. Each instruction is an opcode and an
+ * operand: a function has no operand, an input is its input id and a
+ * constant indexes `consts`. `depth` is the maximum operand stack depth
+ * needed to evaluate the program.
+ *
+ * `hash` and `len` are the structural hash and the number of instructions of
+ * the subtree whose root is instruction `i`, the subtree spans instructions
+ * `i - len[i] + 1` to `i`. Equal subtrees hash the same in any program.
+ *
+ * A compiled program is never modified, so copies of a tree share it, see
+ * program_retain(). program_delete() frees it with its last reference. An
+ * unshared program can be compiled again in place, see program_recompile().
+ */
+typedef struct instr_t {
+  int op;
+  int arg;
+} instr_t;
+
+typedef struct program_t {
+  instr_t *code;
+  int size;
+  int depth;
+  int capacity; /* Instructions the arrays can hold */
+
+  double *consts;
+  int nb_consts;
+
+  uint64_t *hash;
+  int *len;
+
+  atomic_int refs;
+} program_t;
+
+program_t *program_new(const int size) {
+  program_t *p = (program_t *) malloc(sizeof(program_t));
+
+  p->code = (instr_t *) malloc(sizeof(instr_t) * size);
+  p->size = 0;
+  p->depth = 0;
+  p->capacity = size;
+
+  p->consts = (double *) malloc(sizeof(double) * size);
+  p->nb_consts = 0;
+
+  p->hash = (uint64_t *) malloc(sizeof(uint64_t) * size);
+  p->len = (int *) malloc(sizeof(int) * size);
+
+  atomic_init(&p->refs, 1);
+
+  return p;
 }
 
-void tree_print(const tree_t *t) {
-  printf("tree.depth: %d\n", t->depth);
-  printf("tree.size: %d\n", t->size);
-  printf("tree.error: %f\n", t->error);
-  printf("tree.score: %f\n", t->score);
-  printf("tree.nodes:\n");
-  tree_print_traverse(t->root);
+program_t *program_retain(program_t *p) {
+  atomic_fetch_add_explicit(&p->refs, 1, memory_order_relaxed);
+  return p;
 }
 
-/* Tree Build Methods */
-#define FULL 0
-#define GROW 1
+void program_delete(program_t *p) {
+  if (p == NULL) {
+    return;
+  }
+  if (atomic_fetch_sub_explicit(&p->refs, 1, memory_order_acq_rel) > 1) {
+    return;
+  }
+
+  free(p->len);
+  free(p->hash);
+  free(p->consts);
+  free(p->code);
+  free(p);
+}
+
+program_t *program_copy(const program_t *src) {
+  program_t *p = program_new(src->size);
+
+  memcpy(p->code, src->code, sizeof(instr_t) * src->size);
+  p->size = src->size;
+  p->depth = src->depth;
+
+  memcpy(p->consts, src->consts, sizeof(double) * src->nb_consts);
+  p->nb_consts = src->nb_consts;
+
+  memcpy(p->hash, src->hash, sizeof(uint64_t) * src->size);
+  memcpy(p->len, src->len, sizeof(int) * src->size);
+
+  return p;
+}
+
+static int program_count(const node_t *n) {
+  int size = 1;
+  if (n->type == FUNC_NODE) {
+    for (int i = 0; i < n->arity; i++) {
+      size += program_count(n->children[i]);
+    }
+  }
+  return size;
+}
+
+/* Append a terminal, returns its hash */
+static uint64_t program_emit_term(program_t *p,
+                                  const int op,
+                                  const int input,
+                                  const double value,
+                                  int *depth) {
+  instr_t *instr = &p->code[p->size];
+  uint64_t bits = 0;
+  instr->op = op;
+  if (op == OP_INPUT) {
+    instr->arg = input;
+    bits = input;
+  } else {
+    instr->arg = p->nb_consts;
+    p->consts[p->nb_consts++] = value;
+    memcpy(&bits, &value, sizeof(double));
+  }
+  *depth += 1;
+  p->depth = MAX(p->depth, *depth);
+
+  const uint64_t hash = hash_mix(op, bits);
+  p->hash[p->size] = hash;
+  p->len[p->size] = 1;
+  p->size++;
+  return hash;
+}
+
+/* Append a function whose operands start at instruction `start` */
+static void program_emit_func(program_t *p,
+                              const int function,
+                              const int arity,
+                              const int start,
+                              const uint64_t hash,
+                              int *depth) {
+  p->code[p->size].op = function;
+  p->code[p->size].arg = -1;
+  *depth -= arity - 1;
+  p->hash[p->size] = hash;
+  p->len[p->size] = p->size - start + 1;
+  p->size++;
+}
+
+static uint64_t program_compile_traverse(const node_t *n,
+                                         program_t *p,
+                                         int *depth) {
+  if (n->type == TERM_NODE) {
+    if (n->data_type != INPUT && n->data_type != CONST) {
+      FATAL("Opps! Invalid terminal type [%d]!", n->data_type);
+    }
+    const int op = (n->data_type == INPUT) ? OP_INPUT : OP_CONST;
+    return program_emit_term(p, op, n->input, n->value, depth);
+  }
+
+  const int start = p->size;
+  uint64_t hash = hash_mix(n->function, n->arity);
+  for (int i = 0; i < n->arity; i++) {
+    hash = hash_mix(hash, program_compile_traverse(n->children[i], p, depth));
+  }
+  program_emit_func(p, n->function, n->arity, start, hash, depth);
+
+  return hash;
+}
+
+/* Empty unshared program `p` for `size` instructions, new if `p` is NULL */
+static program_t *program_reuse(program_t *p, const int size) {
+  if (p == NULL) {
+    return program_new(size);
+  }
+  assert(atomic_load(&p->refs) == 1);
+  if (size > p->capacity) {
+    p->code = (instr_t *) realloc(p->code, sizeof(instr_t) * size);
+    p->consts = (double *) realloc(p->consts, sizeof(double) * size);
+    p->hash = (uint64_t *) realloc(p->hash, sizeof(uint64_t) * size);
+    p->len = (int *) realloc(p->len, sizeof(int) * size);
+    p->capacity = size;
+  }
+  p->size = 0;
+  p->depth = 0;
+  p->nb_consts = 0;
+  return p;
+}
+
+/**
+ * Compile `root` into unshared program `p`, reusing its arrays, or into a
+ * new program if `p` is NULL.
+ */
+program_t *program_recompile(program_t *p, const node_t *root) {
+  assert(root != NULL);
+
+  p = program_reuse(p, program_count(root));
+  int depth = 0;
+  program_compile_traverse(root, p, &depth);
+
+  return p;
+}
+
+program_t *program_compile(const node_t *root) {
+  return program_recompile(NULL, root);
+}
+
+static uint64_t program_compile_packed_traverse(const cnode_t *nodes,
+                                                int *idx,
+                                                program_t *p,
+                                                int *depth) {
+  const cnode_t *c = &nodes[(*idx)++];
+  if (c->op == OP_INPUT || c->op == OP_CONST) {
+    return program_emit_term(p, c->op, c->input, c->value, depth);
+  }
+
+  const int start = p->size;
+  uint64_t hash = hash_mix(c->op, c->arity);
+  for (int i = 0; i < c->arity; i++) {
+    hash = hash_mix(hash, program_compile_packed_traverse(nodes, idx, p, depth));
+  }
+  program_emit_func(p, c->op, c->arity, start, hash, depth);
+
+  return hash;
+}
+
+/* Same as program_recompile() for the `size` packed nodes `nodes` */
+program_t *program_recompile_packed(program_t *p, const cnode_t *nodes, const int size) {
+  assert(nodes != NULL);
+
+  p = program_reuse(p, size);
+  int idx = 0;
+  int depth = 0;
+  program_compile_packed_traverse(nodes, &idx, p, &depth);
+
+  return p;
+}
+
+/* Same as program_compile() for the `size` packed nodes `nodes` */
+program_t *program_compile_packed(const cnode_t *nodes, const int size) {
+  return program_recompile_packed(NULL, nodes, size);
+}
+
+void program_print(const program_t *p) {
+  assert(p != NULL);
+
+  printf("program.size: %d\n", p->size);
+  printf("program.depth: %d\n", p->depth);
+  printf("program.code:\n");
+  for (int i = 0; i < p->size; i++) {
+    const instr_t *instr = &p->code[i];
+    printf("  [%d]: ", i);
+    switch (instr->op) {
+    case ADD: printf("ADD\n"); break;
+    case SUB: printf("SUB\n"); break;
+    case MUL: printf("MUL\n"); break;
+    case DIV: printf("DIV\n"); break;
+    case POW: printf("POW\n"); break;
+    case EXP: printf("EXP\n"); break;
+    case LOG: printf("LOG\n"); break;
+    case SIN: printf("SIN\n"); break;
+    case COS: printf("COS\n"); break;
+    case OP_INPUT: printf("INPUT\t%s\n", input_name(instr->arg)); break;
+    case OP_CONST: printf("CONST\t%f\n", p->consts[instr->arg]); break;
+    }
+  }
+}
+
+/******************************************************************************
+ *                                   TREE
+ ******************************************************************************/
+
+/**
+ * A tree is stored either as linked nodes from `root`, which the variation
+ * operators work on, or packed as `size` compact nodes in `nodes`, see
+ * tree_pack(). The other is NULL.
+ */
+typedef struct tree_t {
+  node_t *root;
+  cnode_t *nodes;
+  cnode_t *spare; /* Unshared nodes tree_own() reuses, see tree_assign() */
+  int size;
+  int depth;
+
+  double error;
+  double score;
+  /* Evaluation stopped early, the tree cannot beat the bound it was
+   * evaluated against and its error and score are INFINITY */
+  int dominated;
+
+  /* Cached postfix program, NULL until compiled or after a variation */
+  program_t *program;
+  program_t *spare_program; /* Unshared program tree_compile() reuses */
+
+  /* Generation of the dataset binding the node outputs were computed on, 0
+   * if none, see dataset_bind() */
+  long ds_generation;
+} tree_t;
+
+void tree_init(tree_t *t) {
+  t->root = NULL;
+  t->nodes = NULL;
+  t->spare = NULL;
+  t->size = 0;
+  t->depth = 0;
+
+  t->error = 0.0;
+  t->score = 0.0;
+  t->dominated = 0;
+
+  t->program = NULL;
+  t->spare_program = NULL;
+  t->ds_generation = 0;
+}
+
+tree_t *tree_new() {
+  tree_t *t = (tree_t *) malloc(sizeof(tree_t));
+  tree_init(t);
+  return t;
+}
+
+/* Drop the program of `t`, keeping it for tree_compile() if unshared */
+static void tree_drop_program(tree_t *t) {
+  program_t *p = t->program;
+  t->program = NULL;
+  if (p && t->spare_program == NULL &&
+      atomic_load_explicit(&p->refs, memory_order_acquire) == 1) {
+    t->spare_program = p;
+    return;
+  }
+  program_delete(p);
+}
+
+/* Free what tree `t` holds, leaving an empty tree */
+void tree_clear(tree_t *t) {
+  if (t->root != NULL) {
+    node_delete(t->root);
+  }
+  cnode_release(t->nodes);
+  cnode_release(t->spare);
+  program_delete(t->program);
+  program_delete(t->spare_program);
+  tree_init(t);
+}
+
+void tree_delete(tree_t *t) {
+  tree_clear(t);
+  free(t);
+}
+
+/**
+ * Make `dst` a copy of `src` in place. Packed nodes and programs are shared
+ * (see tree_own()), and the unshared nodes and program `dst` held are kept
+ * as spares, so overwriting the trees of a generation with the winners of a
+ * selection allocates nothing.
+ */
+void tree_assign(tree_t *dst, const tree_t *src) {
+  if (dst->nodes) {
+    const int refs = atomic_load_explicit(&CNODE_HEADER(dst->nodes)->refs, memory_order_acquire);
+    if (refs > 1) {
+      cnode_release(dst->nodes);
+    } else if (dst->spare == NULL) {
+      dst->spare = dst->nodes;
+    } else {
+      /* Keep the larger of the two */
+      cnode_t *spare = dst->spare;
+      if (CNODE_HEADER(dst->nodes)->capacity > CNODE_HEADER(spare)->capacity) {
+        dst->spare = dst->nodes;
+      } else {
+        spare = dst->nodes;
+      }
+      cnode_release(spare);
+    }
+    dst->nodes = NULL;
+  }
+  if (dst->root) {
+    node_delete(dst->root);
+    dst->root = NULL;
+  }
+  tree_drop_program(dst);
+
+  if (src->nodes) {
+    dst->nodes = cnode_retain(src->nodes);
+  } else if (src->root) {
+    dst->root = node_copy(src->root);
+  }
+  dst->size = src->size;
+  dst->depth = src->depth;
+
+  dst->error = src->error;
+  dst->score = src->score;
+  dst->dominated = src->dominated;
+
+  dst->program = (src->program) ? program_retain(src->program) : NULL;
+  dst->ds_generation = src->ds_generation;
+}
+
+tree_t *tree_copy(const tree_t *src) {
+  tree_t *t = tree_new();
+  tree_assign(t, src);
+  return t;
+}
+
+/**
+ * Returns 1 if tree `a` is better than tree `b`. A fully evaluated tree beats
+ * a dominated one, and dominated trees are all equal: all that is known of
+ * them is that they are worse than the bound they were evaluated against. A
+ * tree whose score is NaN is worse than any other fully evaluated tree.
+ */
+int tree_better(const tree_t *a, const tree_t *b) {
+  if (a->dominated != b->dominated) {
+    return b->dominated;
+  }
+  if (a->dominated) {
+    return 0;
+  }
+  if (isnan(a->score) || isnan(b->score)) {
+    return isnan(b->score) && !isnan(a->score);
+  }
+  return a->score < b->score;
+}
+
+void tree_compile(tree_t *t) {
+  assert(t != NULL && (t->root != NULL || t->nodes != NULL));
+  tree_drop_program(t);
+  program_t *p = t->spare_program;
+  t->spare_program = NULL;
+  if (t->nodes) {
+    t->program = program_recompile_packed(p, t->nodes, t->size);
+  } else {
+    t->program = program_recompile(p, t->root);
+  }
+}
+
+void tree_invalidate(tree_t *t) {
+  assert(t != NULL);
+  tree_drop_program(t);
+}
+
+static void tree_release_outputs_traverse(node_t *n) {
+  node_output_release(n->output);
+  n->output = NULL;
+  n->output_valid = 0;
+  for (int i = 0; n->type == FUNC_NODE && i < n->arity; i++) {
+    tree_release_outputs_traverse(n->children[i]);
+  }
+}
+
+/* Free the node outputs kept by evaluate_tree_incremental() */
+void tree_release_outputs(tree_t *t) {
+  assert(t != NULL && (t->root != NULL || t->nodes != NULL));
+  if (t->root) {
+    tree_release_outputs_traverse(t->root);
+  }
+  t->ds_generation = 0;
+}
+
+/**
+ * Pack the nodes of `t` into compact nodes, 10 times smaller and contiguous,
+ * e.g. for the trees of a population between generations. Node outputs kept
+ * by evaluate_tree_incremental() are dropped. Packing a packed tree does
+ * nothing. Returns -1 and leaves `t` unpacked if it has more than
+ * CNODE_MAX_SIZE nodes.
+ */
+int tree_pack(tree_t *t) {
+  assert(t != NULL);
+  if (t->root == NULL) {
+    return 0;
+  }
+  t->size = program_count(t->root);
+  if (t->size > CNODE_MAX_SIZE) {
+    return -1;
+  }
+  t->nodes = cnode_alloc(t->size);
+  cnode_pack(t->root, t->nodes, t->size);
+  node_delete(t->root);
+  t->root = NULL;
+  t->ds_generation = 0;
+  return 0;
+}
+
+/* Rebuild the linked nodes of packed tree `t`, does nothing if unpacked */
+void tree_unpack(tree_t *t) {
+  assert(t != NULL);
+  if (t->nodes == NULL) {
+    return;
+  }
+  t->root = cnode_unpack(t->nodes);
+  cnode_release(t->nodes);
+  t->nodes = NULL;
+}
+
+void population_pack(tree_t **trees, const int nb_trees) {
+  for (int i = 0; i < nb_trees; i++) {
+    tree_pack(trees[i]);
+  }
+}
+
+/* End of the subtree of node `idx` of packed tree `t`, O(1) */
+int tree_subtree_end(const tree_t *t, const int idx) {
+  assert(t->nodes != NULL && idx >= 0 && idx < t->size);
+  return idx + t->nodes[idx].len;
+}
+
+/* New packed tree holding a copy of the subtree of node `idx` of packed `t` */
+tree_t *tree_subtree(const tree_t *t, const int idx) {
+  assert(t->nodes != NULL && idx >= 0 && idx < t->size);
+  tree_t *sub = tree_new();
+  sub->size = t->nodes[idx].len;
+  sub->nodes = cnode_alloc(sub->size);
+  memcpy(sub->nodes, t->nodes + idx, sizeof(cnode_t) * sub->size);
+  sub->depth = sub->nodes[0].height;
+  return sub;
+}
+
+/**
+ * Give packed tree `t` its own nodes before changing them, copying them if
+ * other trees share them, into its spare if it has one large enough. Only
+ * the trees a variation touches are copied, so selection shares the nodes of
+ * every winner.
+ */
+void tree_own(tree_t *t) {
+  assert(t->nodes != NULL);
+  if (atomic_load_explicit(&CNODE_HEADER(t->nodes)->refs, memory_order_acquire) == 1) {
+    return;
+  }
+  cnode_t *nodes = t->spare;
+  t->spare = NULL;
+  if (nodes == NULL || CNODE_HEADER(nodes)->capacity < t->size) {
+    cnode_release(nodes);
+    nodes = cnode_alloc(t->size);
+  }
+  memcpy(nodes, t->nodes, sizeof(cnode_t) * t->size);
+  cnode_release(t->nodes);
+  t->nodes = nodes;
+}
+
+/**
+ * Splice below ancestor `j` of node `idx`: update the length of `j`, go down
+ * to the child holding `idx`, and once the subtree is replaced update the
+ * height of `j` from its children.
+ */
+static void cnode_splice_traverse(cnode_t *nodes,
+                                  const int size,
+                                  const int j,
+                                  const int idx,
+                                  const cnode_t *sub,
+                                  const int nb_nodes) {
+  const int old_len = nodes[idx].len;
+  if (j == idx) {
+    const int tail = size - idx - old_len;
+    memmove(nodes + idx + nb_nodes, nodes + idx + old_len, sizeof(cnode_t) * tail);
+    memcpy(nodes + idx, sub, sizeof(cnode_t) * nb_nodes);
+    return;
+  }
+
+  int child = j + 1;
+  while (idx >= child + nodes[child].len) {
+    child += nodes[child].len;
+  }
+  nodes[j].len += nb_nodes - old_len;
+  cnode_splice_traverse(nodes, size, child, idx, sub, nb_nodes);
+  cnode_height_update(nodes, j);
+}
+
+/**
+ * Replace the subtree of node `idx` of packed tree `t` with the `nb_nodes`
+ * packed nodes `sub`. Only the ancestors of `idx` are visited, to update
+ * their lengths and heights, and the nodes after the subtree move with one
+ * memmove(). Returns -1 and leaves `t` unchanged if the result would have
+ * more than CNODE_MAX_SIZE nodes.
+ */
+int tree_splice(tree_t *t, const int idx, const cnode_t *sub, const int nb_nodes) {
+  assert(t->nodes != NULL && idx >= 0 && idx < t->size);
+  const int delta = nb_nodes - t->nodes[idx].len;
+  if (t->size + delta > CNODE_MAX_SIZE) {
+    return -1;
+  }
+
+  tree_own(t);
+  t->nodes = cnode_reserve(t->nodes, t->size + delta);
+  cnode_splice_traverse(t->nodes, t->size, 0, idx, sub, nb_nodes);
+  t->size += delta;
+  t->depth = t->nodes[0].height;
+  tree_invalidate(t);
+
+  return 0;
+}
+
+static void tree_string_traverse(const node_t *n, char *buf, size_t buf_len) {
+  if (n->type == TERM_NODE) {
+    char *s = node_string(n);
+    sprintf(buf + buf_len, "%s ", s);
+    free(s);
+    return;
+  }
+
+  char *s = node_string(n);
+  sprintf(buf + buf_len, "%s ", s);
+  free(s);
+
+  for (int i = 0; i < n->arity; i++) {
+    tree_string_traverse(n->children[i], buf, strlen(buf));
+  }
+}
+
+char *tree_string(const tree_t *t) {
+  char buf[9046] = {0};
+
+  node_t *root = (t->nodes) ? cnode_unpack(t->nodes) : t->root;
+  if (root) {
+    tree_string_traverse(root, buf, 0);
+
+    /* Remove trailing white space */
+    if (buf[strlen(buf) - 1] == ' ') {
+      buf[strlen(buf) - 1] = '\0';
+    }
+  }
+  if (t->nodes) {
+    node_delete(root);
+  }
+
+  return malloc_string(buf);
+}
+
+static void tree_print_traverse(const node_t *n) {
+  if (n->type == TERM_NODE) {
+    printf("  ");
+    node_print(n);
+    return;
+  }
+
+  printf("  ");
+  node_print(n);
+  for (int i = 0; i < n->arity; i++) {
+    tree_print_traverse(n->children[i]);
+  }
+}
+
+void tree_print(const tree_t *t) {
+  printf("tree.depth: %d\n", t->depth);
+  printf("tree.size: %d\n", t->size);
+  printf("tree.error: %f\n", t->error);
+  printf("tree.score: %f\n", t->score);
+  printf("tree.nodes:\n");
+  node_t *root = (t->nodes) ? cnode_unpack(t->nodes) : t->root;
+  tree_print_traverse(root);
+  if (t->nodes) {
+    node_delete(root);
+  }
+}
+
+/* Tree Build Methods */
+#define FULL 0
+#define GROW 1
 #define RAMPED_HALF_AND_HALF 2
 
-static void tree_build(const int method,
+static void tree_build(rng_t *rng,
+                       const int method,
                        tree_t *t,
                        node_t *n,
                        const function_set_t *fs,
@@ -574,15 +1868,15 @@ static void tree_build(const int method,
   for (int i = 0; i < n->arity; i++) {
     if (curr_depth == max_depth) {
       /* Create terminal node */
-      node_t *child = random_term(ts);
+      node_t *child = random_term(rng, ts);
       child->parent = n;
       child->nth_child = i;
       n->children[i] = child;
       t->size++;
 
-    } else if (method == GROW && randf(0, 1.0) > 0.5) {
+    } else if (method == GROW && randf(rng, 0, 1.0) > 0.5) {
       /* Create terminal node */
-      node_t *child = random_term(ts);
+      node_t *child = random_term(rng, ts);
       child->parent = n;
       child->nth_child = i;
       n->children[i] = child;
@@ -590,19 +1884,20 @@ static void tree_build(const int method,
 
     } else {
       /* Create function node */
-      node_t *child = random_func(fs);
+      node_t *child = random_func(rng, fs);
       child->parent = n;
       child->nth_child = i;
       n->children[i] = child;
       t->size++;
 
       /* Recurse deeper */
-      tree_build(method, t, child, fs, ts, curr_depth + 1, max_depth);
+      tree_build(rng, method, t, child, fs, ts, curr_depth + 1, max_depth);
     }
   }
 }
 
-tree_t *tree_generate(const int method,
+tree_t *tree_generate(rng_t *rng,
+                      const int method,
                       const function_set_t *fs,
                       const terminal_set_t *ts,
                       const int max_depth) {
@@ -613,47 +1908,126 @@ tree_t *tree_generate(const int method,
 
   /* Generate tree */
 	tree_t *t = tree_new();
-  t->root = random_func(fs);
+  t->root = random_func(rng, fs);
   t->size++;
   t->depth++;
 
   switch (method) {
     case FULL:
     case GROW:
-      tree_build(method, t, t->root, fs, ts, 1, max_depth);
+      tree_build(rng, method, t, t->root, fs, ts, 1, max_depth);
       break;
     case RAMPED_HALF_AND_HALF:
-      if (randf(0.0, 1.0) > 0.5) {
-        tree_build(FULL, t, t->root, fs, ts, 1, max_depth);
+      if (randf(rng, 0.0, 1.0) > 0.5) {
+        tree_build(rng, FULL, t, t->root, fs, ts, 1, max_depth);
       } else {
-        tree_build(GROW, t, t->root, fs, ts, 1, max_depth);
+        tree_build(rng, GROW, t, t->root, fs, ts, 1, max_depth);
       }
       break;
     default:
 			FATAL("Opps! Unspported tree generation method [%d]!", method);
       return NULL;
   }
+  tree_compile(t);
 
   return t;
 }
 
-static void tree_update_traverse(tree_t *t, node_t *n, const int depth) {
-  assert(t != NULL && n != NULL);
-
-  t->depth = MAX(depth, t->depth);
-  if (n->type == FUNC_NODE) {
-    for (int i = 0; i < n->arity; i++) {
-      n->children[i]->parent = n;
-      n->children[i]->nth_child = i;
-      tree_update_traverse(t, n->children[i], depth + 1);
-    }
-  }
-
-  t->size++;
+/* Random function packed into `c`, drawing as random_func() */
+static void cnode_random_func(rng_t *rng, const function_set_t *fs, cnode_t *c) {
+  assert(fs != NULL);
+  assert(fs->length > 1);
+  const int idx = randi(rng, 0, fs->length - 1);
+  memset(c, 0, sizeof(cnode_t));
+  c->op = fs->funcs[idx];
+  c->arity = fs->arity[idx];
 }
 
-void tree_update(tree_t *t) {
-  assert(t != NULL);
+/* Random terminal packed into `c`, drawing as random_term() */
+static void cnode_random_term(rng_t *rng, const terminal_set_t *ts, cnode_t *c) {
+  assert(ts != NULL);
+  assert(ts->length > 1);
+  const int idx = randi(rng, 0, ts->length - 1);
+  const terminal_t *term = &ts->terms[idx];
+  memset(c, 0, sizeof(cnode_t));
+  c->len = 1;
+
+  switch (term->type) {
+  case INPUT:
+    c->op = OP_INPUT;
+    c->input = input_id(term->str);
+    break;
+  case CONST:
+    c->op = OP_CONST;
+    c->value = term->val;
+    break;
+  case RCONST:
+    c->op = OP_CONST;
+    c->value = randf(rng, term->range[0], term->range[1]);
+    break;
+  }
+}
+
+/* Children of packed function `idx` built as tree_build(), returns its end */
+static int cnode_build(rng_t *rng,
+                       const int method,
+                       cnode_t *nodes,
+                       const int idx,
+                       const function_set_t *fs,
+                       const terminal_set_t *ts,
+                       const int curr_depth,
+                       const int max_depth) {
+  int child = idx + 1;
+  for (int i = 0; i < nodes[idx].arity; i++) {
+    if (curr_depth == max_depth || (method == GROW && randf(rng, 0, 1.0) > 0.5)) {
+      cnode_random_term(rng, ts, &nodes[child]);
+      child++;
+    } else {
+      cnode_random_func(rng, fs, &nodes[child]);
+      child = cnode_build(rng, method, nodes, child, fs, ts, curr_depth + 1, max_depth);
+    }
+  }
+  nodes[idx].len = child - idx;
+  cnode_height_update(nodes, idx);
+
+  return child;
+}
+
+/**
+ * Generate a random tree with FULL or GROW straight into packed nodes
+ * `nodes`, drawing the same numbers as tree_generate() without allocating.
+ * `nodes` must hold a full tree of `max_depth`, e.g. 1 + MAX_ARITY nodes
+ * for a depth of 1. Returns the number of nodes.
+ */
+int cnode_generate(rng_t *rng,
+                   const int method,
+                   const function_set_t *fs,
+                   const terminal_set_t *ts,
+                   const int max_depth,
+                   cnode_t *nodes) {
+  assert(method == FULL || method == GROW);
+  assert(max_depth > 0);
+  cnode_random_func(rng, fs, &nodes[0]);
+  return cnode_build(rng, method, nodes, 0, fs, ts, 1, max_depth);
+}
+
+static void tree_update_traverse(tree_t *t, node_t *n, const int depth) {
+  assert(t != NULL && n != NULL);
+
+  t->depth = MAX(depth, t->depth);
+  if (n->type == FUNC_NODE) {
+    for (int i = 0; i < n->arity; i++) {
+      n->children[i]->parent = n;
+      n->children[i]->nth_child = i;
+      tree_update_traverse(t, n->children[i], depth + 1);
+    }
+  }
+
+  t->size++;
+}
+
+void tree_update(tree_t *t) {
+  assert(t != NULL && t->root != NULL);
 
   /* Reset size and depth */
   t->depth = 0;
@@ -683,17 +2057,18 @@ static node_t *tree_get_node_traverse(node_t *n,
 }
 
 node_t *tree_get_node(const tree_t *t, const int idx) {
+  assert(t->root != NULL);
   int curr_idx = 0;
   return tree_get_node_traverse(t->root, idx, &curr_idx);
 }
 
-int tree_select_rand_func(const tree_t *t) {
+int tree_select_rand_func(rng_t *rng, const tree_t *t) {
   assert(t != NULL);
 
   int attempts = 0;
   int idx = 0;
 try_again:
-  idx = randi(0, t->size - 1);
+  idx = randi(rng, 0, t->size - 1);
   node_t *n = tree_get_node(t, idx);
   if (n->type != FUNC_NODE) {
     attempts++;
@@ -705,7 +2080,7 @@ try_again:
   return idx;
 }
 
-static void tree_stack_traverse(node_t *n, stack_t *s) {
+static void tree_stack_traverse(node_t *n, sr_stack_t *s) {
   if (n->type == TERM_NODE) {
     stack_push(s, n);
     return;
@@ -717,7 +2092,8 @@ static void tree_stack_traverse(node_t *n, stack_t *s) {
   stack_push(s, n);
 }
 
-void tree_stack(const tree_t *t, stack_t *s) {
+void tree_stack(const tree_t *t, sr_stack_t *s) {
+  assert(t->root != NULL);
   tree_stack_traverse(t->root, s);
 }
 
@@ -742,20 +2118,17 @@ int subtree_size(const node_t *root) {
  *                           MUTATION OPERATORS
  ******************************************************************************/
 
-static void mutate_term_node(const terminal_set_t *ts, node_t *n) {
+static void mutate_term_node(rng_t *rng, const terminal_set_t *ts, node_t *n) {
 	/* Clear terminal node */
   n->data_type = -1;
   n->value = 0.0;
-	if (n->input_name) {
-		free(n->input_name);
-		n->input_name = NULL;
-	}
+  n->input = -1;
 
 	/* Mutate terminal node */
-  node_t *new_term = random_term(ts);
+  node_t *new_term = random_term(rng, ts);
 	if (new_term->data_type == INPUT) {
 		n->data_type = INPUT;
-		n->input_name = malloc_string(new_term->input_name);
+		n->input = new_term->input;
 	} else if (new_term->data_type == CONST) {
 		n->data_type = CONST;
 		n->value = new_term->value;
@@ -763,12 +2136,12 @@ static void mutate_term_node(const terminal_set_t *ts, node_t *n) {
 	node_delete(new_term);
 }
 
-static void mutate_func_node(const function_set_t *fs, node_t *n) {
+static void mutate_func_node(rng_t *rng, const function_set_t *fs, node_t *n) {
   int attempts = 0;
 
 try_again:
   {
-    int i = randi(0, fs->length - 1);
+    int i = randi(rng, 0, fs->length - 1);
     if (fs->arity[i] != n->arity && attempts < 1000) {
       attempts++;
       goto try_again;
@@ -779,37 +2152,89 @@ try_again:
   }
 }
 
-void point_mutation(const function_set_t *fs,
+void point_mutation(rng_t *rng,
+                    const function_set_t *fs,
                     const terminal_set_t *ts,
                     tree_t *t) {
-  const int idx = randi(0, t->size - 1);
+  const int idx = randi(rng, 0, t->size - 1);
+
+  /* Packed tree, mutate the node in place */
+  if (t->nodes) {
+    tree_own(t);
+    cnode_t *c = &t->nodes[idx];
+    node_t n;
+    memset(&n, 0, sizeof(node_t));
+    if (c->arity == 0) {
+      mutate_term_node(rng, ts, &n);
+      c->op = (n.data_type == INPUT) ? OP_INPUT : OP_CONST;
+      c->value = 0.0;
+      if (n.data_type == INPUT) {
+        c->input = n.input;
+      } else {
+        c->value = n.value;
+      }
+    } else {
+      n.function = c->op;
+      n.arity = c->arity;
+      mutate_func_node(rng, fs, &n);
+      c->op = n.function;
+    }
+    tree_invalidate(t);
+    return;
+  }
+
   node_t *n = tree_get_node(t, idx);
 
   if (n->type == TERM_NODE) {
-    mutate_term_node(ts, n);
+    mutate_term_node(rng, ts, n);
   } else if (n->type == FUNC_NODE) {
-    mutate_func_node(fs, n);
+    mutate_func_node(rng, fs, n);
   }
 
 	tree_update(t);
+  tree_invalidate(t);
+  node_invalidate(n);
 }
 
-void subtree_mutation(const function_set_t *fs,
+void subtree_mutation(rng_t *rng,
+                      const function_set_t *fs,
                       const terminal_set_t *ts,
                       tree_t *t) {
-  const int index = randi(0, t->size - 1);
-  node_t *subtree = tree_get_node(t, index);
+  const int index = randi(rng, 0, t->size - 1);
+
+  /* Packed tree, splice in a new subtree generated on the stack */
+  node_t *new_root = NULL;
+  if (t->nodes) {
+    cnode_t sub[1 + MAX_ARITY];
+    const int nb_nodes = cnode_generate(rng, GROW, fs, ts, 1, sub);
+    if (tree_splice(t, index, sub, nb_nodes) == 0) {
+      return;
+    }
+
+    /* Too large to stay packed */
+    tree_unpack(t);
+    new_root = cnode_unpack(sub);
+  } else {
+    tree_t *new_subtree = tree_generate(rng, GROW, fs, ts, 1);
+    new_root = new_subtree->root;
+    new_subtree->root = NULL;
+    tree_delete(new_subtree);
+  }
 
-  tree_t *new_subtree = tree_generate(GROW, fs, ts, 1);
+  node_t *subtree = tree_get_node(t, index);
   node_t *parent = subtree->parent;
   const int nth_child = subtree->nth_child;
   /* printf("nth_child: %d\n", nth_child); */
-  parent->children[nth_child] = new_subtree->root;
-  new_subtree->root->parent = parent;
-  new_subtree->root->nth_child = nth_child;
+  if (parent == NULL) {
+    t->root = new_root;
+  } else {
+    parent->children[nth_child] = new_root;
+  }
+  new_root->parent = parent;
+  new_root->nth_child = nth_child;
   tree_update(t);
-
-  free(new_subtree);
+  tree_invalidate(t);
+  node_invalidate(parent);
   node_delete(subtree);
 }
 
@@ -817,11 +2242,39 @@ void subtree_mutation(const function_set_t *fs,
  *                           CROSSOVER OPERATORS
  ******************************************************************************/
 
-void point_crossover(tree_t *t1, tree_t *t2) {
-  const int t1_pt = randi(1, t1->size - 1);
-  node_t *t1_subtree = tree_get_node(t1, t1_pt);
+/**
+ * Swap a random subtree of `t1` with one of `t2`, neither being a root. Two
+ * packed trees stay packed. Otherwise both are swapped as node trees, so a
+ * parent that was not packed keeps the outputs of the nodes off the spines
+ * the swap changed.
+ */
+void point_crossover(rng_t *rng, tree_t *t1, tree_t *t2) {
+  /* Crossover points exclude the roots */
+  if (t1->size < 2 || t2->size < 2) {
+    return;
+  }
+  const int t1_pt = randi(rng, 1, t1->size - 1);
+  const int t2_pt = randi(rng, 1, t2->size - 1);
+
+  /* Packed trees, swap the subtrees with two splices */
+  if (t1->nodes && t2->nodes) {
+    const int t1_len = t1->nodes[t1_pt].len;
+    const int t2_len = t2->nodes[t2_pt].len;
+    if (t1->size - t1_len + t2_len <= CNODE_MAX_SIZE &&
+        t2->size - t2_len + t1_len <= CNODE_MAX_SIZE) {
+      cnode_t *t1_subtree = cnode_scratch(t1_len);
+      memcpy(t1_subtree, t1->nodes + t1_pt, sizeof(cnode_t) * t1_len);
+      tree_splice(t1, t1_pt, t2->nodes + t2_pt, t2_len);
+      tree_splice(t2, t2_pt, t1_subtree, t1_len);
+      return;
+    }
+  }
 
-  const int t2_pt = randi(2, t2->size - 1);
+  /* Node trees, or packed offspring too large to stay packed */
+  tree_unpack(t1);
+  tree_unpack(t2);
+
+  node_t *t1_subtree = tree_get_node(t1, t1_pt);
   node_t *t2_subtree = tree_get_node(t2, t2_pt);
 
   const int t1_nth_child = t1_subtree->nth_child;
@@ -839,30 +2292,40 @@ void point_crossover(tree_t *t1, tree_t *t2) {
 
 	tree_update(t1);
 	tree_update(t2);
+  tree_invalidate(t1);
+  tree_invalidate(t2);
+  node_invalidate(t1_parent);
+  node_invalidate(t2_parent);
 }
 
 /******************************************************************************
  *                          SELECTION OPERATORS
  ******************************************************************************/
 
-tree_t **tournament_selection(tree_t **trees,
+/* Best of a tournament of `t_size + 1` trees drawn at random */
+static tree_t *tournament(rng_t *rng,
+                          tree_t **trees,
+                          const int nb_trees,
+                          const int t_size) {
+  tree_t *best = trees[randi(rng, 0, nb_trees - 1)];
+  for (int j = 0; j < t_size; j++) {
+    tree_t *t = trees[randi(rng, 0, nb_trees - 1)];
+    if (tree_better(t, best)) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+tree_t **tournament_selection(rng_t *rng,
+                              tree_t **trees,
                               const int nb_trees,
                               const int t_size) {
   tree_t **new_trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
 
   /* Tournamenet selection */
   for (int i = 0; i < nb_trees; i++) {
-    /* Form tournament - keep best */
-    int idx = randi(0, nb_trees - 1);
-    tree_t *best = trees[idx];
-    for (int j = 0; j < t_size; j++) {
-      tree_t *t = trees[randi(0, nb_trees - 1)];
-      if (t->score < best->score) {
-        best = t;
-      }
-    }
-
-    new_trees[i] = tree_copy(best);
+    new_trees[i] = tree_copy(tournament(rng, trees, nb_trees, t_size));
   }
 
   /* Delete old generation */
@@ -986,13 +2449,15 @@ char **csv_fields(const char *fp, int *nb_fields) {
 	return fields;
 }
 
-double **csv_data(const char *fp, int *nb_rows, int *nb_cols) {
+/* Read the columns of csv file `fp`, from mem_alloc() if `mem` is set */
+static double **csv_read(const char *fp, int *nb_rows, int *nb_cols, const int mem) {
 	/* Initialize memory for csv data */
 	*nb_rows = csv_rows(fp);
 	*nb_cols = csv_cols(fp);
 	double **data = (double **) malloc(sizeof(double *) * *nb_cols);
 	for (int i = 0; i < *nb_cols; i++) {
-		data[i] = (double *) malloc(sizeof(double) * *nb_rows);
+		const size_t size = sizeof(double) * *nb_rows;
+		data[i] = (mem) ? (double *) mem_alloc(size, "dataset column") : (double *) malloc(size);
 	}
 
 	/* Load file */
@@ -1039,6 +2504,11 @@ double **csv_data(const char *fp, int *nb_rows, int *nb_cols) {
 	return data;
 }
 
+/* Columns of csv file `fp`, free each and the array with free() */
+double **csv_data(const char *fp, int *nb_rows, int *nb_cols) {
+  return csv_read(fp, nb_rows, nb_cols, 0);
+}
+
 struct dataset_t {
 	int nb_rows;
 	int nb_cols;
@@ -1046,13 +2516,65 @@ struct dataset_t {
 	double **data;
 	char **fields;
 	char *predict;
+
+  /* Bindings, see dataset_bind() */
+  int *inputs;
+  int nb_inputs;
+  double *target;
+  long generation; /* Unique to each binding, see subtree_cache_bind() */
+
+  /* Shared memory mapping the columns point into, see dataset_shm_attach() */
+  void *shm;
+  size_t shm_size;
 } typedef dataset_t;
 
+int dataset_field(const dataset_t *ds, const char *field) {
+	for (int field_idx = 0; field_idx < ds->nb_cols; field_idx++) {
+    if (strcmp(ds->fields[field_idx], field) == 0) {
+      return field_idx;
+    }
+  }
+
+  return -1;
+}
+
+/* Generation of the last dataset bound */
+static atomic_long dataset_generation = 0;
+
+void dataset_bind(dataset_t *ds) {
+  /* Every field becomes an input */
+  for (int i = 0; i < ds->nb_cols; i++) {
+    input_id(ds->fields[i]);
+  }
+
+  /* Map input ids to columns, -1 if the input is not in this dataset */
+  free(ds->inputs);
+  ds->nb_inputs = inputs_length;
+  ds->inputs = (int *) malloc(sizeof(int) * ds->nb_inputs);
+  for (int i = 0; i < ds->nb_inputs; i++) {
+    ds->inputs[i] = dataset_field(ds, input_name(i));
+  }
+
+  /* Cache the column to predict */
+  const int field_idx = dataset_field(ds, ds->predict);
+  ds->target = (field_idx == -1) ? NULL : ds->data[field_idx];
+
+  /* A new binding, even of a dataset at the address of a deleted one */
+  ds->generation = atomic_fetch_add(&dataset_generation, 1) + 1;
+}
+
+int dataset_column(const dataset_t *ds, const int input) {
+  if (input >= ds->nb_inputs || ds->inputs[input] == -1) {
+    FATAL("Opps! Input [%s] not found in dataset!", input_name(input));
+  }
+  return ds->inputs[input];
+}
+
 dataset_t *dataset_load(const char *fp, const char *predict) {
 	dataset_t *ds = (dataset_t *) malloc(sizeof(dataset_t));
 
 	/* Load data */
-	ds->data = csv_data(fp, &ds->nb_rows, &ds->nb_cols);
+	ds->data = csv_read(fp, &ds->nb_rows, &ds->nb_cols, 1);
 	if (ds->data == NULL) {
 		FATAL("Failed to load dataset [%s]!", fp);
 	}
@@ -1067,14 +2589,24 @@ dataset_t *dataset_load(const char *fp, const char *predict) {
 	/* Set field to predict */
 	ds->predict = malloc_string(predict);
 
+  /* Bind inputs and target to columns */
+  ds->inputs = NULL;
+  dataset_bind(ds);
+  ds->shm = NULL;
+  ds->shm_size = 0;
+
   return ds;
 }
 
 void dataset_delete(dataset_t *ds) {
 	/* Free data */
-	for (int i = 0; i < ds->nb_cols; i++) {
-		free(ds->data[i]);
-	}
+  if (ds->shm) {
+    munmap(ds->shm, ds->shm_size);
+  } else {
+    for (int i = 0; i < ds->nb_cols; i++) {
+      mem_free(ds->data[i]);
+    }
+  }
 	free(ds->data);
 
 	/* Free fields */
@@ -1083,8 +2615,9 @@ void dataset_delete(dataset_t *ds) {
 	}
 	free(ds->fields);
 
-	/* Free predict */
+	/* Free predict and bindings */
 	free(ds->predict);
+	free(ds->inputs);
 
 	/* Free dataset itself */
 	free(ds);
@@ -1092,152 +2625,3525 @@ void dataset_delete(dataset_t *ds) {
 }
 
 double *dataset_expected(const dataset_t *ds) {
-  int field_idx = 0;
-  int field_found = 0;
-	for (field_idx = 0; field_idx < ds->nb_cols; field_idx++) {
-    if (strcmp(ds->fields[field_idx], ds->predict) == 0) {
-      field_found = 1;
-      break;
+  return ds->target;
+}
+
+/**
+ * An operand of a program instruction. Vector operands point straight at a
+ * dataset column or an intermediate result, scalar operands (data == NULL)
+ * are constants and are never broadcast into a buffer.
+ */
+typedef struct operand_t {
+  const double *data;
+  double value;
+} operand_t;
+
+/**
+ * Row kernels of a function. `vv`, `vs` and `sv` take vector-vector,
+ * vector-scalar and scalar-vector operands, `ss` folds two scalars. Unary
+ * functions only use `vv` and `ss` and ignore their second operand.
+ */
+typedef struct kernel_t {
+  double (*ss)(const double x, const double y);
+  void (*vv)(const double *x, const double *y, double *z, const int n);
+  void (*vs)(const double *x, const double y, double *z, const int n);
+  void (*sv)(const double x, const double *y, double *z, const int n);
+} kernel_t;
+
+#define UNARY_FUNC(NAME, FUNC) \
+  static double NAME##_ss(const double x, const double y) { \
+    return FUNC(x); \
+  } \
+  static void NAME##_vv(const double *x, const double *y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = FUNC(x[i]); \
+    } \
+  }
+
+#define BINARY_OP(NAME, OPERATOR) \
+  static double NAME##_ss(const double x, const double y) { \
+    return x OPERATOR y; \
+  } \
+  static void NAME##_vv(const double *x, const double *y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = x[i] OPERATOR y[i]; \
+    } \
+  } \
+  static void NAME##_vs(const double *x, const double y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = x[i] OPERATOR y; \
+    } \
+  } \
+  static void NAME##_sv(const double x, const double *y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = x OPERATOR y[i]; \
+    } \
+  }
+
+#define BINARY_FUNC(NAME, FUNC) \
+  static double NAME##_ss(const double x, const double y) { \
+    return FUNC(x, y); \
+  } \
+  static void NAME##_vv(const double *x, const double *y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = FUNC(x[i], y[i]); \
+    } \
+  } \
+  static void NAME##_vs(const double *x, const double y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = FUNC(x[i], y); \
+    } \
+  } \
+  static void NAME##_sv(const double x, const double *y, double *z, const int n) { \
+    for (int i = 0; i < n; i++) { \
+      z[i] = FUNC(x, y[i]); \
+    } \
+  }
+
+BINARY_OP(kernel_add, +)
+BINARY_OP(kernel_sub, -)
+BINARY_OP(kernel_mul, *)
+BINARY_OP(kernel_div, /)
+BINARY_FUNC(kernel_pow, pow)
+UNARY_FUNC(kernel_exp, exp)
+UNARY_FUNC(kernel_log, log)
+UNARY_FUNC(kernel_sin, sin)
+UNARY_FUNC(kernel_cos, cos)
+
+/* Scalar kernels indexed by function type */
+static const kernel_t kernels_scalar[9] = {
+  {kernel_add_ss, kernel_add_vv, kernel_add_vs, kernel_add_sv},
+  {kernel_sub_ss, kernel_sub_vv, kernel_sub_vs, kernel_sub_sv},
+  {kernel_mul_ss, kernel_mul_vv, kernel_mul_vs, kernel_mul_sv},
+  {kernel_div_ss, kernel_div_vv, kernel_div_vs, kernel_div_sv},
+  {kernel_pow_ss, kernel_pow_vv, kernel_pow_vs, kernel_pow_sv},
+  {kernel_exp_ss, kernel_exp_vv, NULL, NULL},
+  {kernel_log_ss, kernel_log_vv, NULL, NULL},
+  {kernel_sin_ss, kernel_sin_vv, NULL, NULL},
+  {kernel_cos_ss, kernel_cos_vv, NULL, NULL}
+};
+
+/* SIMD Instruction Sets */
+#define SIMD_NONE 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+#define SIMD_AVX512 3
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) \
+    && !defined(__TINYC__)
+#define SR_SIMD
+
+#define KERNEL_ISA sse2
+#define KERNEL_WIDTH 2
+#define KERNEL_LIBM_LOG
+#include "kernels.h"
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define KERNEL_ISA avx2
+#define KERNEL_WIDTH 4
+#include "kernels.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define KERNEL_ISA avx512
+#define KERNEL_WIDTH 8
+#include "kernels.h"
+#pragma GCC pop_options
+#endif
+
+/* Kernels in use and the instruction set they were built for */
+static const kernel_t *kernels = kernels_scalar;
+static int kernels_simd = SIMD_NONE;
+
+int simd_supported(const int simd) {
+  switch (simd) {
+  case SIMD_NONE: return 1;
+#ifdef SR_SIMD
+  case SIMD_SSE2: return 1;
+  case SIMD_AVX2: return __builtin_cpu_supports("avx2");
+  case SIMD_AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+  }
+
+  return 0;
+}
+
+int simd_detect() {
+  for (int simd = SIMD_AVX512; simd > SIMD_NONE; simd--) {
+    if (simd_supported(simd)) {
+      return simd;
     }
   }
 
-  if (field_found == 0) {
-    return NULL;
+  return SIMD_NONE;
+}
+
+const char *simd_string(const int simd) {
+  switch (simd) {
+  case SIMD_NONE: return "none";
+  case SIMD_SSE2: return "sse2";
+  case SIMD_AVX2: return "avx2";
+  case SIMD_AVX512: return "avx512";
   }
 
-  return ds->data[field_idx];
+  return "unknown";
 }
 
-void evaluate_resolve_node(const node_t *node, const dataset_t *ds, double *arg) {
-  if (node->data_type == CONST) {
-		/* Load constant */
-		for (int i = 0; i < ds->nb_rows; i++) {
-			arg[i] = node->value;
-		}
+/**
+ * Select the kernels built for instruction set `simd`. Returns -1 if the CPU
+ * does not support it. Not thread-safe, kernels are selected at startup
+ * (see `kernels_init()`) and should only be changed while nothing evaluates.
+ */
+int kernels_select(const int simd) {
+  if (simd_supported(simd) == 0) {
+    return -1;
+  }
 
-  } else if (node->data_type == INPUT) {
-		/* Find field */
-		int found_field = 0;
-		int field_idx = 0;
-		for (field_idx = 0; field_idx < ds->nb_cols; field_idx++) {
-			if (strcmp(ds->fields[field_idx], node->input_name) == 0) {
-				found_field = 1;
-				break;
-			}
-		}
-		if (found_field == 0) {
-			FATAL("Opps! Input [%s] not found in dataset!", node->input_name)
-		}
+  switch (simd) {
+  case SIMD_NONE: kernels = kernels_scalar; break;
+#ifdef SR_SIMD
+  case SIMD_SSE2: kernels = kernels_sse2; break;
+  case SIMD_AVX2: kernels = kernels_avx2; break;
+  case SIMD_AVX512: kernels = kernels_avx512; break;
+#endif
+  }
+  kernels_simd = simd;
 
-		/* Load input data */
-		for (int i = 0; i < ds->nb_rows; i++) {
-			arg[i] = ds->data[field_idx][i];
-		}
+  return 0;
+}
 
-  } else if (node->data_type == EVAL) {
-		/* Load eval data */
-		for (int i = 0; i < ds->nb_rows; i++) {
-			arg[i] = node->eval_data[i];
-		}
+#ifdef SR_SIMD
+__attribute__((constructor)) static void kernels_init() {
+  __builtin_cpu_init();
+  kernels_select(simd_detect());
+}
+#endif
+
+static void evaluate_unary(const kernel_t *k,
+                           const operand_t *x,
+                           double *z,
+                           const int n,
+                           operand_t *result) {
+  if (x->data == NULL) {
+    result->data = NULL;
+    result->value = k->ss(x->value, 0.0);
+  } else {
+    k->vv(x->data, NULL, z, n);
+    result->data = z;
+  }
+}
 
+static void evaluate_binary(const kernel_t *k,
+                            const operand_t *x,
+                            const operand_t *y,
+                            double *z,
+                            const int n,
+                            operand_t *result) {
+  if (x->data == NULL && y->data == NULL) {
+    result->data = NULL;
+    result->value = k->ss(x->value, y->value);
+    return;
+  }
+
+  if (x->data == NULL) {
+    k->sv(x->value, y->data, z, n);
+  } else if (y->data == NULL) {
+    k->vs(x->data, y->value, z, n);
   } else {
-    FATAL("Opps! shouldn't be here!")
+    k->vv(x->data, y->data, z, n);
   }
+  result->data = z;
+}
+
+/**
+ * Subtree cache, maps the structural hash of a subtree to its values on the
+ * rows of a dataset, so subtrees shared by many trees (selection copies
+ * winners, so most of them) are evaluated once.
+ *
+ * An entry's values are filled in row order as tiles are evaluated, and a
+ * lookup hits once the rows of its tile are filled. A subtree is only
+ * admitted the second time it is evaluated so one-off subtrees do not flush
+ * the cache, and entries are evicted in CLOCK order to stay under `budget`
+ * bytes. An entry keeps the instructions of its subtree, with constants by
+ * value, and a lookup compares them, so subtrees whose hashes collide get
+ * entries of their own instead of each other's values.
+ *
+ * A cache holds values of one dataset binding, evaluating another clears it.
+ * Keep it across generations or call subtree_cache_clear() between them. Not
+ * thread-safe.
+ */
+
+/* Instruction of a cached subtree, `arg` is an input id or constant bits */
+typedef struct cache_instr_t {
+  int op;
+  uint64_t arg;
+} cache_instr_t;
+
+typedef struct cache_entry_t {
+  uint64_t hash;
+  int len;
+  double *data;  /* NULL until admitted */
+  int nb_rows;   /* Rows filled */
+  int referenced;
+  long pinned;   /* Epoch of the last tile that read it */
+  int idx;       /* Index in entries */
+  struct cache_entry_t *next;
+  cache_instr_t code[]; /* The `len` instructions of the subtree */
+} cache_entry_t;
+
+/* Bytes of an entry for a subtree of `len` instructions, without values */
+#define CACHE_ENTRY_SIZE(LEN) (sizeof(cache_entry_t) + sizeof(cache_instr_t) * (LEN))
+
+typedef struct subtree_cache_t {
+  cache_entry_t **buckets;
+  int nb_buckets;
+  cache_entry_t **entries;
+  int nb_entries;
+  int max_entries;
+  int hand;
+  long epoch;
+
+  long generation; /* Of the dataset the values are of */
+  int nb_rows;
+  size_t bytes;
+  size_t budget;
+
+  /* Counters */
+  long hits;
+  long misses;
+  long admissions;
+  long evictions;
+  long collisions;
+} subtree_cache_t;
+
+subtree_cache_t *subtree_cache_new(const size_t budget) {
+  subtree_cache_t *cache = (subtree_cache_t *) malloc(sizeof(subtree_cache_t));
+
+  cache->nb_buckets = 1024;
+  cache->buckets = (cache_entry_t **) calloc(cache->nb_buckets, sizeof(cache_entry_t *));
+  cache->entries = NULL;
+  cache->nb_entries = 0;
+  cache->max_entries = 0;
+  cache->hand = 0;
+  cache->epoch = 0;
+
+  cache->generation = 0;
+  cache->nb_rows = 0;
+  cache->bytes = 0;
+  cache->budget = budget;
+
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->admissions = 0;
+  cache->evictions = 0;
+  cache->collisions = 0;
+
+  return cache;
 }
 
-#define UNARY_FUNC(FUNC) \
-  node_t *n_arg0 = (node_t *) stack_pop(&eval_stack); \
-  evaluate_resolve_node(n_arg0, ds, arg0); \
-  for (int i = 0; i < ds->nb_rows; i++) { \
-    eval->eval_data[i] = FUNC(arg0[i]); \
+static void subtree_cache_remove(subtree_cache_t *cache, cache_entry_t *e) {
+  /* Unlink from bucket */
+  cache_entry_t **link = &cache->buckets[e->hash & (cache->nb_buckets - 1)];
+  while (*link != e) {
+    link = &(*link)->next;
+  }
+  *link = e->next;
+
+  /* Remove from entries, the last entry takes its place */
+  cache_entry_t *last = cache->entries[--cache->nb_entries];
+  cache->entries[e->idx] = last;
+  last->idx = e->idx;
+
+  cache->bytes -= CACHE_ENTRY_SIZE(e->len);
+  if (e->data) {
+    cache->bytes -= sizeof(double) * cache->nb_rows;
+    mem_free(e->data);
   }
+  free(e);
+}
 
-#define BINARY_OP(OPERATOR) \
-  node_t *n_arg0 = (node_t *) stack_pop(&eval_stack); \
-  node_t *n_arg1 = (node_t *) stack_pop(&eval_stack); \
-  evaluate_resolve_node(n_arg0, ds, arg0); \
-  evaluate_resolve_node(n_arg1, ds, arg1); \
-  for (int i = 0; i < ds->nb_rows; i++) { \
-    eval->eval_data[i] = arg0[i] OPERATOR arg1[i]; \
+/**
+ * Clear all entries. The counters are kept, they describe the whole run.
+ */
+void subtree_cache_clear(subtree_cache_t *cache) {
+  while (cache->nb_entries) {
+    subtree_cache_remove(cache, cache->entries[cache->nb_entries - 1]);
   }
+  cache->hand = 0;
+}
+
+void subtree_cache_delete(subtree_cache_t *cache) {
+  subtree_cache_clear(cache);
+  free(cache->entries);
+  free(cache->buckets);
+  free(cache);
+}
 
-#define BINARY_FUNC(FUNC) \
-  node_t *n_arg0 = (node_t *) stack_pop(&eval_stack); \
-  node_t *n_arg1 = (node_t *) stack_pop(&eval_stack); \
-  evaluate_resolve_node(n_arg0, ds, arg0); \
-  evaluate_resolve_node(n_arg1, ds, arg1); \
-  for (int i = 0; i < ds->nb_rows; i++) { \
-    eval->eval_data[i] = FUNC(arg0[i], arg1[i]); \
+/**
+ * Clear the cache if it holds values of another dataset binding. Bindings
+ * are told apart by generation rather than address, which a dataset may
+ * reuse from a deleted one.
+ */
+static void subtree_cache_bind(subtree_cache_t *cache, const dataset_t *ds) {
+  if (cache->generation != ds->generation) {
+    subtree_cache_clear(cache);
+    cache->generation = ds->generation;
+    cache->nb_rows = ds->nb_rows;
   }
+}
 
-int evaluate_tree(tree_t *t, const dataset_t *ds) {
-  stack_t eq_stack;
-  stack_t eval_stack;
-  stack_setup(&eq_stack);
-  stack_setup(&eval_stack);
-  tree_stack(t, &eq_stack);
-
-	double *arg0 = (double *) malloc(sizeof(double) * ds->nb_rows);
-	double *arg1 = (double *) malloc(sizeof(double) * ds->nb_rows);
-	node_t *eval = node_new_eval(ds->nb_rows);
-
-  /* while (eq_stack.size != 0) { */
-    /* node_t *n = stack_pop(&eq_stack); */
-  for (int k = 0; k < eq_stack.size; k++) {
-    node_t *n = (node_t *) eq_stack.data[k];
-
-    if (n->type == FUNC_NODE) {
-			switch (n->function) {
-			case ADD: {BINARY_OP(+); break;}
-			case SUB: {BINARY_OP(-); break;}
-			case MUL: {BINARY_OP(*); break;}
-			case DIV: {BINARY_OP(/); break;}
-			case POW: {BINARY_FUNC(pow); break;}
-			case EXP: {UNARY_FUNC(exp); break;}
-			case LOG: {UNARY_FUNC(log); break;}
-			case SIN: {UNARY_FUNC(sin); break;}
-			case COS: {UNARY_FUNC(cos); break;}
-			default: FATAL("Opps! Function not implemented [%d]\n", n->function);
-			}
-      stack_push(&eval_stack, eval);
+/* Instruction `i` of program `p` as kept by a cache entry */
+static cache_instr_t cache_instr(const program_t *p, const int i) {
+  cache_instr_t instr;
+  instr.op = p->code[i].op;
+  instr.arg = 0;
+  if (instr.op == OP_INPUT) {
+    instr.arg = p->code[i].arg;
+  } else if (instr.op == OP_CONST) {
+    memcpy(&instr.arg, &p->consts[p->code[i].arg], sizeof(double));
+  }
+  return instr;
+}
+
+/* Returns 1 if entry `e` holds the subtree of program `p` rooted at `k` */
+static int cache_entry_matches(const cache_entry_t *e, const program_t *p, const int k) {
+  const int start = k - e->len + 1;
+  for (int i = 0; i < e->len; i++) {
+    const cache_instr_t instr = cache_instr(p, start + i);
+    if (instr.op != e->code[i].op || instr.arg != e->code[i].arg) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Entry of the subtree of program `p` rooted at instruction `k`, if any */
+static cache_entry_t *subtree_cache_find(subtree_cache_t *cache,
+                                         const program_t *p,
+                                         const int k) {
+  const uint64_t hash = p->hash[k];
+  const int len = p->len[k];
+  cache_entry_t *e = cache->buckets[hash & (cache->nb_buckets - 1)];
+  for (; e; e = e->next) {
+    if (e->hash != hash || e->len != len) {
+      continue;
+    }
+    if (cache_entry_matches(e, p, k)) {
+      return e;
+    }
+    cache->collisions++;
+  }
+  return NULL;
+}
+
+/* Evict entries until `bytes` more fit in the budget, entries read by the
+ * current tile are kept. Returns -1 if they do not fit. */
+static int subtree_cache_evict(subtree_cache_t *cache, const size_t bytes) {
+  int nb_pinned = 0; /* Consecutive entries found pinned */
+  while (cache->bytes + bytes > cache->budget) {
+    if (nb_pinned >= cache->nb_entries) {
+      return -1;
+    }
+
+    cache->hand = (cache->hand >= cache->nb_entries) ? 0 : cache->hand;
+    cache_entry_t *e = cache->entries[cache->hand];
+    if (e->pinned == cache->epoch) {
+      nb_pinned++;
+      cache->hand++;
+    } else if (e->referenced) {
+      nb_pinned = 0;
+      e->referenced = 0;
+      cache->hand++;
     } else {
-      stack_push(&eval_stack, n);
+      nb_pinned = 0;
+      subtree_cache_remove(cache, e);
+      cache->evictions++;
     }
   }
 
-  /* Calculate RMSE */
-  const double *predicted = eval->eval_data;
-  const double *expected = dataset_expected(ds);
-  const double n = ds->nb_rows;
+  return 0;
+}
+
+static void subtree_cache_add(subtree_cache_t *cache, const program_t *p, const int k) {
+  const uint64_t hash = p->hash[k];
+  const int len = p->len[k];
+  if (subtree_cache_evict(cache, CACHE_ENTRY_SIZE(len)) != 0) {
+    return;
+  }
+
+  /* Grow buckets to keep chains short */
+  if (cache->nb_entries >= cache->nb_buckets) {
+    const int nb_buckets = cache->nb_buckets * 2;
+    cache_entry_t **buckets = (cache_entry_t **) calloc(nb_buckets, sizeof(cache_entry_t *));
+    for (int i = 0; i < cache->nb_entries; i++) {
+      cache_entry_t *e = cache->entries[i];
+      e->next = buckets[e->hash & (nb_buckets - 1)];
+      buckets[e->hash & (nb_buckets - 1)] = e;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->nb_buckets = nb_buckets;
+  }
+  if (cache->nb_entries == cache->max_entries) {
+    cache->max_entries = (cache->max_entries) ? cache->max_entries * 2 : 1024;
+    cache->entries = (cache_entry_t **) realloc(cache->entries, sizeof(cache_entry_t *) * cache->max_entries);
+  }
+
+  cache_entry_t *e = (cache_entry_t *) malloc(CACHE_ENTRY_SIZE(len));
+  e->hash = hash;
+  e->len = len;
+  for (int i = 0; i < len; i++) {
+    e->code[i] = cache_instr(p, k - len + 1 + i);
+  }
+  e->data = NULL;
+  e->nb_rows = 0;
+  e->referenced = 1;
+  e->pinned = -1;
+  e->idx = cache->nb_entries;
+  e->next = cache->buckets[hash & (cache->nb_buckets - 1)];
+  cache->buckets[hash & (cache->nb_buckets - 1)] = e;
+  cache->entries[cache->nb_entries++] = e;
+  cache->bytes += CACHE_ENTRY_SIZE(len);
+}
+
+/**
+ * Values of the subtree of program `p` rooted at instruction `k` on rows
+ * [`row`, `row + nb_rows`), NULL if they are not cached.
+ */
+const double *subtree_cache_lookup(subtree_cache_t *cache,
+                                   const program_t *p,
+                                   const int k,
+                                   const int row,
+                                   const int nb_rows) {
+  cache_entry_t *e = subtree_cache_find(cache, p, k);
+  if (e == NULL || e->data == NULL || row + nb_rows > e->nb_rows) {
+    cache->misses++;
+    return NULL;
+  }
+
+  e->referenced = 1;
+  e->pinned = cache->epoch;
+  cache->hits++;
+  return e->data + row;
+}
+
+/**
+ * Offer the values of the subtree of program `p` rooted at instruction `k`
+ * on rows [`row`, `row + nb_rows`) to the cache.
+ */
+void subtree_cache_store(subtree_cache_t *cache,
+                         const program_t *p,
+                         const int k,
+                         const int row,
+                         const int nb_rows,
+                         const double *values) {
+  cache_entry_t *e = subtree_cache_find(cache, p, k);
+
+  /* First sighting */
+  if (e == NULL) {
+    if (row == 0) {
+      subtree_cache_add(cache, p, k);
+    }
+    return;
+  }
+
+  /* Second sighting, admit */
+  if (e->data == NULL) {
+    const size_t bytes = sizeof(double) * cache->nb_rows;
+    e->pinned = cache->epoch;
+    if (row != 0 || subtree_cache_evict(cache, bytes) != 0) {
+      return;
+    }
+    e->data = (double *) mem_alloc(bytes, "subtree cache entry");
+    cache->bytes += bytes;
+    cache->admissions++;
+  }
+
+  /* Fill in row order */
+  e->referenced = 1;
+  if (e->nb_rows == row) {
+    memcpy(e->data + row, values, sizeof(double) * nb_rows);
+    e->nb_rows += nb_rows;
+  }
+}
+
+void subtree_cache_print(const subtree_cache_t *cache) {
+  const long lookups = cache->hits + cache->misses;
+  printf("cache.entries: %d\n", cache->nb_entries);
+  printf("cache.bytes: %zu / %zu\n", cache->bytes, cache->budget);
+  printf("cache.hits: %ld\n", cache->hits);
+  printf("cache.misses: %ld\n", cache->misses);
+  printf("cache.hit_rate: %f\n", (lookups) ? (double) cache->hits / lookups : 0.0);
+  printf("cache.admissions: %ld\n", cache->admissions);
+  printf("cache.evictions: %ld\n", cache->evictions);
+  printf("cache.collisions: %ld\n", cache->collisions);
+}
+
+/* Default number of rows evaluated at a time, a tile buffer is 4KB */
+#define EVAL_TILE_ROWS 512
+
+/* Number of tiles whose squared errors are summed before adding them to a
+ * tree's total, see population_evaluate_ctx() */
+#define EVAL_BLOCK_TILES 64
+
+/**
+ * Evaluation context, holds the scratch row buffers intermediate results are
+ * written to. Programs run over tiles of `tile_rows` rows (0 evaluates all
+ * rows at once), so buffers are one tile long and their size does not depend
+ * on the dataset. Buffers only grow, so once they fit the deepest program
+ * evaluation no longer allocates. They are cache line aligned slices of one
+ * scratch region from mem_alloc(). A context must only be used by one thread
+ * at a time.
+ */
+typedef struct eval_ctx_t {
+  double *scratch;
+  double **buffers;
+  int nb_buffers;
+  int nb_rows;
+  int tile_rows;
+
+  /* Per tree sums of squared errors and dominance flags, see
+   * population_evaluate_ctx() */
+  double *err_sq;
+  double *block_err_sq;
+  int *dominated;
+  int nb_err_sq;
+
+  /* Optional subtree cache, not owned */
+  subtree_cache_t *cache;
+} eval_ctx_t;
+
+eval_ctx_t *eval_ctx_new() {
+  eval_ctx_t *ctx = (eval_ctx_t *) malloc(sizeof(eval_ctx_t));
+  ctx->scratch = NULL;
+  ctx->buffers = NULL;
+  ctx->nb_buffers = 0;
+  ctx->nb_rows = 0;
+  ctx->tile_rows = EVAL_TILE_ROWS;
+  ctx->err_sq = NULL;
+  ctx->block_err_sq = NULL;
+  ctx->dominated = NULL;
+  ctx->nb_err_sq = 0;
+  ctx->cache = NULL;
+  return ctx;
+}
+
+void eval_ctx_delete(eval_ctx_t *ctx) {
+  mem_free(ctx->scratch);
+  free(ctx->buffers);
+  free(ctx->err_sq);
+  free(ctx->block_err_sq);
+  free(ctx->dominated);
+  free(ctx);
+}
+
+void eval_ctx_reserve(eval_ctx_t *ctx, const int nb_buffers, const int nb_rows) {
+  if (nb_rows <= ctx->nb_rows && nb_buffers <= ctx->nb_buffers) {
+    return;
+  }
+  const int new_rows = MAX(nb_rows, ctx->nb_rows);
+  const int new_buffers = MAX(nb_buffers, ctx->nb_buffers);
+
+  /* Buffers start on a cache line */
+  const size_t stride = (new_rows + 7) / 8 * 8;
+  double *scratch = (double *) mem_alloc(sizeof(double) * stride * new_buffers, "eval scratch");
+  ctx->buffers = (double **) realloc(ctx->buffers, sizeof(double *) * new_buffers);
+  for (int i = 0; i < new_buffers; i++) {
+    double *buffer = scratch + i * stride;
+
+    /* Existing buffers keep their values unless they are too short */
+    if (i < ctx->nb_buffers && new_rows == ctx->nb_rows) {
+      memcpy(buffer, ctx->buffers[i], sizeof(double) * ctx->nb_rows);
+    }
+    ctx->buffers[i] = buffer;
+  }
+  mem_free(ctx->scratch);
+  ctx->scratch = scratch;
+  ctx->nb_rows = new_rows;
+  ctx->nb_buffers = new_buffers;
+}
+
+/* Default context of the calling thread, used by evaluate_tree() */
+static _Thread_local eval_ctx_t *eval_ctx_thread = NULL;
+
+eval_ctx_t *eval_ctx_default() {
+  if (eval_ctx_thread == NULL) {
+    eval_ctx_thread = eval_ctx_new();
+  }
+  return eval_ctx_thread;
+}
+
+/* Free the default context of the calling thread, e.g. before it exits */
+void eval_ctx_default_release() {
+  if (eval_ctx_thread) {
+    eval_ctx_delete(eval_ctx_thread);
+    eval_ctx_thread = NULL;
+  }
+}
+
+/**
+ * Run program `p` on rows [`row`, `row + nb_rows`) of dataset `ds` and
+ * return the sum of squared errors of the prediction.
+ *
+ * Buffers are assigned by operand stack slot: an instruction that leaves its
+ * result in slot `i` writes it to `ctx->buffers[i]`. A slot's value is dead
+ * once it is consumed, and the kernels are elementwise, so writing a result
+ * over its own first operand is safe and a program needs at most `depth`
+ * buffers.
+ *
+ * With a subtree cache the largest cached subtrees are read from the cache
+ * instead of evaluated, and the other subtrees are offered to it.
+ */
+static double evaluate_tile(eval_ctx_t *ctx,
+                            const program_t *p,
+                            const dataset_t *ds,
+                            const int row,
+                            const int nb_rows) {
+  /* Find cached subtrees, from the root down */
+  subtree_cache_t *cache = ctx->cache;
+  const double *cached[MAX_TREE_SIZE];
+  int cached_end[MAX_TREE_SIZE];
+  if (cache) {
+    cache->epoch++;
+    memset(cached, 0, sizeof(double *) * p->size);
+    int k = p->size - 1;
+    while (k >= 0) {
+      const int start = k - p->len[k] + 1;
+      if (p->len[k] > 1) {
+        cached[start] = subtree_cache_lookup(cache, p, k, row, nb_rows);
+      }
+      if (cached[start]) {
+        cached_end[start] = k;
+        k = start - 1;
+      } else {
+        k--;
+      }
+    }
+  }
+
+  /* Run program */
+  operand_t operands[MAX_TREE_SIZE];
+  int nb_operands = 0;
+  for (int k = 0; k < p->size; k++) {
+    const instr_t *instr = &p->code[k];
+    operand_t *top = &operands[nb_operands];
+
+    if (cache && cached[k]) {
+      top->data = cached[k];
+      nb_operands++;
+      k = cached_end[k];
+      continue;
+    }
+
+    switch (instr->op) {
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case POW:
+      nb_operands--;
+      evaluate_binary(&kernels[instr->op], top - 2, top - 1,
+                      ctx->buffers[nb_operands - 1], nb_rows, top - 2);
+      break;
+    case EXP:
+    case LOG:
+    case SIN:
+    case COS:
+      evaluate_unary(&kernels[instr->op], top - 1,
+                     ctx->buffers[nb_operands - 1], nb_rows, top - 1);
+      break;
+    case OP_INPUT:
+      top->data = ds->data[dataset_column(ds, instr->arg)] + row;
+      nb_operands++;
+      break;
+    case OP_CONST:
+      top->data = NULL;
+      top->value = p->consts[instr->arg];
+      nb_operands++;
+      break;
+    default: FATAL("Opps! Function not implemented [%d]\n", instr->op);
+    }
+
+    if (cache && p->len[k] > 1 && operands[nb_operands - 1].data) {
+      subtree_cache_store(cache, p, k, row, nb_rows, operands[nb_operands - 1].data);
+    }
+  }
+
+  /* Fold squared error */
+  const operand_t *predicted = &operands[0];
+  const double *expected = dataset_expected(ds) + row;
   double err_sq = 0.0;
-  for (int i = 0; i < n; i++) {
-    const double err = predicted[i] - expected[i];
+  for (int i = 0; i < nb_rows; i++) {
+    const double y = (predicted->data) ? predicted->data[i] : predicted->value;
+    const double err = y - expected[i];
     err_sq += err * err;
   }
-  const double rmse = sqrt(err_sq / n);
 
-  /* Set error and score */
-  t->error = rmse;
-  t->score = rmse + (t->size) * 0.1;
-  /* t->score = rmse; */
+  return err_sq;
+}
 
-  /* Clean up */
-  free(arg0);
-  free(arg1);
-  node_delete(eval);
+static int evaluate_tile_rows(const eval_ctx_t *ctx, const dataset_t *ds) {
+  if (ctx->tile_rows > 0 && ctx->tile_rows < ds->nb_rows) {
+    return ctx->tile_rows;
+  }
+  return ds->nb_rows;
+}
 
-  return 0;
+static int evaluate_block_rows(const eval_ctx_t *ctx, const dataset_t *ds) {
+  const int tile_rows = evaluate_tile_rows(ctx, ds);
+  if (tile_rows > ds->nb_rows / EVAL_BLOCK_TILES) {
+    return ds->nb_rows;
+  }
+  return tile_rows * EVAL_BLOCK_TILES;
 }
 
-tree_t *best_tree(tree_t **trees, int nb_trees) {
-  tree_t *best = trees[0];
+/* Score of tree `t` given the sum of squared errors over the dataset, a lower
+ * bound of the score if only part of the rows were evaluated */
+static double evaluate_score_bound(const tree_t *t,
+                                   const dataset_t *ds,
+                                   const double err_sq) {
+  return sqrt(err_sq / ds->nb_rows) + (t->size) * 0.1;
+  /* return sqrt(err_sq / ds->nb_rows); */
+}
+
+static void evaluate_score(tree_t *t,
+                           const dataset_t *ds,
+                           const double err_sq,
+                           const int dominated) {
+  t->error = (dominated) ? INFINITY : sqrt(err_sq / ds->nb_rows);
+  t->score = (dominated) ? INFINITY : evaluate_score_bound(t, ds, err_sq);
+  t->dominated = dominated;
+}
+
+/* Compile the trees that changed since their last evaluation */
+static void evaluate_compile(tree_t **trees, const int nb_trees) {
   for (int i = 0; i < nb_trees; i++) {
-    if (trees[i]->score <= best->score) {
-      best = trees[i];
+    if (trees[i]->program == NULL) {
+      tree_compile(trees[i]);
     }
+    assert(trees[i]->program->size <= MAX_TREE_SIZE);
   }
+}
 
-  return best;
+/* Grow the scratch of `ctx` to evaluate compiled trees `trees` on `ds` */
+static void evaluate_reserve(eval_ctx_t *ctx,
+                             tree_t **trees,
+                             const int nb_trees,
+                             const dataset_t *ds) {
+  int depth = 0;
+  for (int i = 0; i < nb_trees; i++) {
+    depth = MAX(depth, trees[i]->program->depth);
+  }
+  eval_ctx_reserve(ctx, depth, evaluate_tile_rows(ctx, ds));
+  if (ctx->cache) {
+    subtree_cache_bind(ctx->cache, ds);
+  }
+
+  if (nb_trees > ctx->nb_err_sq) {
+    free(ctx->err_sq);
+    free(ctx->block_err_sq);
+    free(ctx->dominated);
+    ctx->err_sq = (double *) malloc(sizeof(double) * nb_trees);
+    ctx->block_err_sq = (double *) malloc(sizeof(double) * nb_trees);
+    ctx->dominated = (int *) malloc(sizeof(int) * nb_trees);
+    ctx->nb_err_sq = nb_trees;
+  }
+}
+
+/**
+ * Evaluate compiled trees `trees` on the block of rows [`row`, `row +
+ * nb_rows`), tile by tile and every tree per tile, and add the block's sum of
+ * squared errors of tree `i` to `err_sq[i]`.
+ *
+ * Trees flagged in `dominated` are skipped. A tree is flagged once the rows
+ * it was evaluated on, `err_sq[i]` on entry plus the block so far, show it
+ * cannot score below `max_score`.
+ */
+static void evaluate_block(eval_ctx_t *ctx,
+                           tree_t **trees,
+                           const int nb_trees,
+                           const dataset_t *ds,
+                           const int row,
+                           const int nb_rows,
+                           const double max_score,
+                           double *err_sq,
+                           int *dominated) {
+  const int tile_rows = evaluate_tile_rows(ctx, ds);
+  double *block_err_sq = ctx->block_err_sq;
+  for (int i = 0; i < nb_trees; i++) {
+    block_err_sq[i] = 0.0;
+  }
+
+  for (int tile = row; tile < row + nb_rows; tile += tile_rows) {
+    const int tile_size = MIN(tile_rows, row + nb_rows - tile);
+    for (int i = 0; i < nb_trees; i++) {
+      if (dominated[i]) {
+        continue;
+      }
+      const tree_t *t = trees[i];
+      block_err_sq[i] += evaluate_tile(ctx, t->program, ds, tile, tile_size);
+      dominated[i] = (evaluate_score_bound(t, ds, err_sq[i] + block_err_sq[i]) > max_score);
+    }
+  }
+
+  for (int i = 0; i < nb_trees; i++) {
+    err_sq[i] += block_err_sq[i];
+  }
+}
+
+/**
+ * Evaluate `nb_trees` trees on dataset `ds` using the scratch buffers of
+ * `ctx`, stopping early for trees that cannot score below `max_score`
+ * (INFINITY for no bound).
+ *
+ * Programs run over one tile of `ctx->tile_rows` rows before moving to the
+ * next, so intermediates stay in cache instead of streaming through memory.
+ * Unlike evaluating tree by tree, every program runs over a tile before the
+ * next tile, so the input columns of a tile are loaded from memory once and
+ * stay in cache for the whole population.
+ *
+ * Squared errors are summed per block of EVAL_BLOCK_TILES tiles, then block
+ * by block, the order population_evaluate_pool() reduces them in when the
+ * blocks of a tree are evaluated by different threads.
+ *
+ * The squared errors of the rows seen so far give a lower bound of the RMSE,
+ * so a tree is not evaluated further once that bound plus the size penalty
+ * exceeds `max_score`. The tree is then marked dominated and its error and
+ * score set to INFINITY. The partial sums are not kept: they depend on how
+ * many rows were seen before the cut, so ranking by them would be arbitrary.
+ */
+int population_evaluate_ctx(eval_ctx_t *ctx,
+                            tree_t **trees,
+                            const int nb_trees,
+                            const dataset_t *ds,
+                            const double max_score) {
+  evaluate_compile(trees, nb_trees);
+  evaluate_reserve(ctx, trees, nb_trees, ds);
+  for (int i = 0; i < nb_trees; i++) {
+    ctx->err_sq[i] = 0.0;
+    ctx->dominated[i] = (evaluate_score_bound(trees[i], ds, 0.0) > max_score);
+  }
+
+  /* Evaluate block by block */
+  const int block_rows = evaluate_block_rows(ctx, ds);
+  for (int row = 0; row < ds->nb_rows; row += block_rows) {
+    const int nb_rows = MIN(block_rows, ds->nb_rows - row);
+    evaluate_block(ctx, trees, nb_trees, ds, row, nb_rows, max_score,
+                   ctx->err_sq, ctx->dominated);
+  }
+
+  /* Set errors and scores */
+  for (int i = 0; i < nb_trees; i++) {
+    evaluate_score(trees[i], ds, ctx->err_sq[i], ctx->dominated[i]);
+  }
+
+  return 0;
+}
+
+/**
+ * Evaluate tree `t` on dataset `ds` using the scratch buffers of `ctx`,
+ * stopping early if it cannot score below `max_score`. See
+ * population_evaluate_ctx().
+ */
+int evaluate_tree_ctx(eval_ctx_t *ctx,
+                      tree_t *t,
+                      const dataset_t *ds,
+                      const double max_score) {
+  return population_evaluate_ctx(ctx, &t, 1, ds, max_score);
+}
+
+int evaluate_tree(tree_t *t, const dataset_t *ds) {
+  return evaluate_tree_ctx(eval_ctx_default(), t, ds, INFINITY);
+}
+
+/**
+ * Evaluate tree `t`, stopping early if it cannot score below `max_score`,
+ * e.g. selection_bound() of the previous generation. See evaluate_tree_ctx().
+ */
+int evaluate_tree_bounded(tree_t *t, const dataset_t *ds, const double max_score) {
+  return evaluate_tree_ctx(eval_ctx_default(), t, ds, max_score);
+}
+
+int population_evaluate(tree_t **trees, const int nb_trees, const dataset_t *ds) {
+  return population_evaluate_ctx(eval_ctx_default(), trees, nb_trees, ds, INFINITY);
+}
+
+static void evaluate_node_invalidate(node_t *n) {
+  n->output_valid = 0;
+  for (int i = 0; n->type == FUNC_NODE && i < n->arity; i++) {
+    evaluate_node_invalidate(n->children[i]);
+  }
+}
+
+static operand_t evaluate_node(node_t *n, const dataset_t *ds) {
+  operand_t result;
+
+  /* Terminals */
+  if (n->type == TERM_NODE) {
+    if (n->data_type == INPUT) {
+      result.data = ds->data[dataset_column(ds, n->input)];
+    } else {
+      result.data = NULL;
+      result.value = n->value;
+    }
+    return result;
+  }
+
+  /* Unchanged since the last evaluation */
+  if (n->output_valid) {
+    result.data = n->output;
+    return result;
+  }
+
+  /* Evaluate children, then this node into its output, copies keep theirs */
+  if (n->output == NULL || NODE_OUTPUT_HEADER(n->output)->rows != ds->nb_rows ||
+      node_output_shared(n->output)) {
+    node_output_release(n->output);
+    n->output = node_output_alloc(ds->nb_rows);
+  }
+  const kernel_t *k = &kernels[n->function];
+  const operand_t x = evaluate_node(n->children[0], ds);
+  if (n->arity == 1) {
+    evaluate_unary(k, &x, n->output, ds->nb_rows, &result);
+  } else {
+    const operand_t y = evaluate_node(n->children[1], ds);
+    evaluate_binary(k, &x, &y, n->output, ds->nb_rows, &result);
+  }
+
+  /* Scalar results are cheap to recompute and not kept */
+  n->output_valid = (result.data != NULL);
+
+  return result;
+}
+
+/**
+ * Evaluate tree `t` on dataset `ds`, keeping the output of every function
+ * node on every row. A variation operator marks the nodes it changed and
+ * their ancestors stale (see node_invalidate()), so evaluating the offspring
+ * only recomputes the path from the changed nodes to the root and reuses the
+ * outputs of the other subtrees. Copies of the tree share the outputs.
+ *
+ * This trades memory, one row vector per function node, for time: use it for
+ * deep trees on large datasets, release the outputs with
+ * tree_release_outputs(). A packed tree is unpacked first.
+ */
+int evaluate_tree_incremental(tree_t *t, const dataset_t *ds) {
+  /* Packed trees have no node outputs to reuse */
+  tree_unpack(t);
+
+  /* Outputs of another dataset are stale */
+  if (t->ds_generation != ds->generation) {
+    evaluate_node_invalidate(t->root);
+    t->ds_generation = ds->generation;
+  }
+
+  /* Evaluate */
+  const operand_t predicted = evaluate_node(t->root, ds);
+
+  /* Calculate RMSE */
+  const double *expected = dataset_expected(ds);
+  double err_sq = 0.0;
+  for (int i = 0; i < ds->nb_rows; i++) {
+    const double y = (predicted.data) ? predicted.data[i] : predicted.value;
+    const double err = y - expected[i];
+    err_sq += err * err;
+  }
+  evaluate_score(t, ds, err_sq, 0);
+
+  return 0;
+}
+
+/**
+ * Evaluate `nb_trees` trees with evaluate_tree_incremental(), e.g. offspring
+ * bred by population_vary() from a generation evaluated this way: selection
+ * shares the node outputs of the winners, so only the spines variation
+ * changed are recomputed.
+ */
+int population_evaluate_incremental(tree_t **trees, const int nb_trees, const dataset_t *ds) {
+  for (int i = 0; i < nb_trees; i++) {
+    evaluate_tree_incremental(trees[i], ds);
+  }
+  return 0;
+}
+
+/* Best of `nb_trees` trees, the first of equally good ones */
+tree_t *best_tree(tree_t **trees, int nb_trees) {
+  tree_t *best = trees[0];
+  for (int i = 0; i < nb_trees; i++) {
+    if (tree_better(trees[i], best)) {
+      best = trees[i];
+    }
+  }
+
+  return best;
+}
+
+static int selection_bound_cmp(const void *a, const void *b) {
+  const double x = *(const double *) a;
+  const double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Bound to evaluate the offspring of generation `trees` against: the median
+ * score of its fully evaluated trees, INFINITY if there are none. Offspring
+ * that cannot beat it are cut short and tie below every other tree, but a
+ * tree worse than the median rarely wins a tournament anyway, so selection
+ * keeps its pressure over the better half. Bounding by the best score would
+ * cut short almost every offspring and leave selection below it random.
+ */
+double selection_bound(tree_t **trees, const int nb_trees) {
+  double *scores = (double *) malloc(sizeof(double) * nb_trees);
+  int nb_scores = 0;
+  for (int i = 0; i < nb_trees; i++) {
+    if (trees[i]->dominated == 0 && isnan(trees[i]->score) == 0) {
+      scores[nb_scores++] = trees[i]->score;
+    }
+  }
+
+  double bound = INFINITY;
+  if (nb_scores) {
+    qsort(scores, nb_scores, sizeof(double), selection_bound_cmp);
+    bound = scores[nb_scores / 2];
+  }
+  free(scores);
+
+  return bound;
+}
+
+/******************************************************************************
+ *                               THREAD POOL
+ ******************************************************************************/
+
+/**
+ * Task `task` of a job, run by worker `worker` (0 is the thread that called
+ * threadpool_run()).
+ */
+typedef void (*task_func_t)(void *arg, const int task, const int worker);
+
+/**
+ * Work-stealing deque of task indices. The owner pushes and pops at the
+ * bottom, other workers steal from the top, so the owner and thieves work at
+ * opposite ends of its tasks.
+ */
+typedef struct deque_t {
+  int *tasks;
+  int capacity;
+  int top;
+  int bottom;
+  pthread_mutex_t lock;
+} deque_t;
+
+void deque_init(deque_t *q) {
+  q->tasks = NULL;
+  q->capacity = 0;
+  q->top = 0;
+  q->bottom = 0;
+  pthread_mutex_init(&q->lock, NULL);
+}
+
+void deque_free(deque_t *q) {
+  pthread_mutex_destroy(&q->lock);
+  free(q->tasks);
+}
+
+void deque_push(deque_t *q, const int task) {
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom == q->capacity) {
+    /* Move the tasks left to the front before growing */
+    const int n = q->bottom - q->top;
+    if (n > 0) {
+      memmove(q->tasks, q->tasks + q->top, sizeof(int) * n);
+    }
+    q->top = 0;
+    q->bottom = n;
+    if (n == q->capacity) {
+      q->capacity = MAX(16, q->capacity * 2);
+      q->tasks = (int *) realloc(q->tasks, sizeof(int) * q->capacity);
+    }
+  }
+  q->tasks[q->bottom++] = task;
+  pthread_mutex_unlock(&q->lock);
+}
+
+/* Pop the newest task, -1 if the deque is empty */
+int deque_pop(deque_t *q) {
+  int task = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom > q->top) {
+    task = q->tasks[--q->bottom];
+  }
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+/* Steal the oldest task, -1 if the deque is empty */
+int deque_steal(deque_t *q) {
+  int task = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom > q->top) {
+    task = q->tasks[q->top++];
+  }
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+/* Per worker counters, accumulated over jobs until threadpool_stats_reset() */
+typedef struct threadpool_stats_t {
+  long tasks;         /* Tasks run */
+  long steals;        /* Tasks stolen from other workers */
+  long failed_steals; /* Workers found empty while looking for a task */
+  double busy;        /* Seconds spent running tasks */
+} threadpool_stats_t;
+
+/**
+ * Persistent worker threads. A job is split into `nb_tasks` tasks dealt out
+ * to the workers' deques in contiguous ranges. Each worker runs its own tasks
+ * in order and, once its deque is empty, steals from the others, so workers
+ * that drew cheap tasks take over the tail of workers that drew expensive
+ * ones. Tasks can spawn more tasks (see threadpool_spawn()), the job is done
+ * once no task is queued or running. The threads then wait for the next job
+ * instead of exiting, so a pool is created once and reused every generation.
+ */
+typedef struct threadpool_t {
+  pthread_t *threads;
+  int nb_threads; /* Including the calling thread */
+  deque_t *deques;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work; /* New job or shutdown */
+  pthread_cond_t more; /* Task spawned or job done */
+  pthread_cond_t done; /* All workers left the job */
+
+  /* Current job */
+  task_func_t func;
+  void *arg;
+  atomic_int nb_queued;  /* Tasks in the deques */
+  atomic_int nb_pending; /* Tasks queued or running */
+  int nb_active;         /* Workers looking for or running tasks */
+  long job;
+  int shutdown;
+
+  /* Placement, see threadpool_pin() */
+  int *cpus;            /* CPU each worker is pinned to, -1 if not pinned */
+  int *nodes;           /* NUMA node of each worker */
+  cpu_set_t *affinity;  /* Affinity of the calling thread before pinning */
+
+  /* Statistics */
+  threadpool_stats_t *stats;
+  long nb_jobs;
+  double elapsed; /* Seconds spent in threadpool_run() */
+} threadpool_t;
+
+typedef struct threadpool_worker_t {
+  threadpool_t *pool;
+  int worker;
+} threadpool_worker_t;
+
+static double threadpool_time() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Steal a task from the other workers, -1 if none are left */
+static int threadpool_steal(threadpool_t *pool,
+                            const int worker,
+                            threadpool_stats_t *stats) {
+  for (int i = 1; i < pool->nb_threads; i++) {
+    const int victim = (worker + i) % pool->nb_threads;
+    const int task = deque_steal(&pool->deques[victim]);
+    if (task >= 0) {
+      stats->steals++;
+      return task;
+    }
+    stats->failed_steals++;
+  }
+  return -1;
+}
+
+/**
+ * Run tasks of the current job until it is done. A worker that finds every
+ * deque empty while tasks are still running waits, since those may spawn
+ * more.
+ */
+static void threadpool_work(threadpool_t *pool, const int worker) {
+  threadpool_stats_t stats = pool->stats[worker];
+
+  while (1) {
+    int task = deque_pop(&pool->deques[worker]);
+    if (task < 0) {
+      task = threadpool_steal(pool, worker, &stats);
+    }
+
+    if (task >= 0) {
+      atomic_fetch_sub(&pool->nb_queued, 1);
+      const double start = threadpool_time();
+      pool->func(pool->arg, task, worker);
+      stats.busy += threadpool_time() - start;
+      stats.tasks++;
+
+      /* Last task of the job, wake the waiting workers so they leave */
+      if (atomic_fetch_sub(&pool->nb_pending, 1) == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->more);
+        pthread_mutex_unlock(&pool->lock);
+      }
+      continue;
+    }
+
+    /* Wait for a spawned task or the end of the job */
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->nb_pending) > 0 && atomic_load(&pool->nb_queued) == 0) {
+      pthread_cond_wait(&pool->more, &pool->lock);
+    }
+    const int done = (atomic_load(&pool->nb_pending) == 0);
+    pthread_mutex_unlock(&pool->lock);
+    if (done) {
+      break;
+    }
+  }
+  pool->stats[worker] = stats;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->nb_active--;
+  if (pool->nb_active == 0) {
+    pthread_cond_broadcast(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Queue task `task` of the current job on the deque of `worker`, to be called
+ * by a task running on `worker`. Other workers can steal it.
+ */
+void threadpool_spawn(threadpool_t *pool, const int worker, const int task) {
+  atomic_fetch_add(&pool->nb_pending, 1);
+  atomic_fetch_add(&pool->nb_queued, 1);
+  deque_push(&pool->deques[worker], task);
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_broadcast(&pool->more);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *threadpool_worker(void *data) {
+  threadpool_worker_t *w = (threadpool_worker_t *) data;
+  threadpool_t *pool = w->pool;
+  long job = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->job == job && pool->shutdown == 0) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    job = pool->job;
+
+    /* Woken after the job was done */
+    if (atomic_load(&pool->nb_pending) == 0) {
+      continue;
+    }
+
+    pool->nb_active++;
+    pthread_mutex_unlock(&pool->lock);
+    threadpool_work(pool, w->worker);
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  /* Free the thread's evaluation scratch buffers and node caches */
+  eval_ctx_default_release();
+  node_cache_release();
+  cnode_scratch_release();
+  free(w);
+
+  return NULL;
+}
+
+void threadpool_stats_reset(threadpool_t *pool) {
+  for (int i = 0; i < pool->nb_threads; i++) {
+    pool->stats[i].tasks = 0;
+    pool->stats[i].steals = 0;
+    pool->stats[i].failed_steals = 0;
+    pool->stats[i].busy = 0.0;
+  }
+  pool->nb_jobs = 0;
+  pool->elapsed = 0.0;
+}
+
+/**
+ * Create a pool of `nb_threads` threads including the calling thread, one per
+ * online CPU if `nb_threads` <= 0.
+ */
+threadpool_t *threadpool_new(int nb_threads) {
+  if (nb_threads <= 0) {
+    nb_threads = MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+  }
+
+  threadpool_t *pool = (threadpool_t *) malloc(sizeof(threadpool_t));
+  pool->nb_threads = nb_threads;
+  pool->deques = (deque_t *) malloc(sizeof(deque_t) * nb_threads);
+  for (int i = 0; i < nb_threads; i++) {
+    deque_init(&pool->deques[i]);
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->more, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->func = NULL;
+  pool->arg = NULL;
+  atomic_init(&pool->nb_queued, 0);
+  atomic_init(&pool->nb_pending, 0);
+  pool->nb_active = 0;
+  pool->job = 0;
+  pool->shutdown = 0;
+
+  pool->cpus = (int *) malloc(sizeof(int) * nb_threads);
+  pool->nodes = (int *) malloc(sizeof(int) * nb_threads);
+  for (int i = 0; i < nb_threads; i++) {
+    pool->cpus[i] = -1;
+    pool->nodes[i] = 0;
+  }
+  pool->affinity = NULL;
+
+  pool->stats = (threadpool_stats_t *) malloc(sizeof(threadpool_stats_t) * nb_threads);
+  threadpool_stats_reset(pool);
+
+  pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * nb_threads);
+  for (int i = 1; i < nb_threads; i++) {
+    threadpool_worker_t *w = (threadpool_worker_t *) malloc(sizeof(threadpool_worker_t));
+    w->pool = pool;
+    w->worker = i;
+    if (pthread_create(&pool->threads[i], NULL, threadpool_worker, w) != 0) {
+      FATAL("Failed to create worker thread!");
+    }
+  }
+
+  return pool;
+}
+
+/**
+ * Stop the workers and free `pool`. A pinned pool gives the calling thread
+ * back the affinity it had before threadpool_pin(), so delete it from the
+ * thread that pinned it.
+ */
+void threadpool_delete(threadpool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 1; i < pool->nb_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->more);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    deque_free(&pool->deques[i]);
+  }
+  free(pool->deques);
+  if (pool->affinity) {
+    sched_setaffinity(0, sizeof(cpu_set_t), pool->affinity);
+    free(pool->affinity);
+  }
+  free(pool->nodes);
+  free(pool->cpus);
+  free(pool->stats);
+  free(pool->threads);
+  free(pool);
+}
+
+/**
+ * Run `func` for tasks 0 to `nb_tasks - 1`, and the tasks they spawn, on the
+ * pool and return once all are done. The calling thread runs tasks too. Not
+ * reentrant, a pool runs one job at a time.
+ */
+void threadpool_run(threadpool_t *pool,
+                    task_func_t func,
+                    void *arg,
+                    const int nb_tasks) {
+  if (nb_tasks == 0) {
+    return;
+  }
+  const double start = threadpool_time();
+
+  /* Deal out tasks in contiguous ranges, pushed last to first so each worker
+   * pops its range in order and thieves take it from the end */
+  for (int i = 0; i < pool->nb_threads; i++) {
+    const int first = (int) ((long) nb_tasks * i / pool->nb_threads);
+    const int last = (int) ((long) nb_tasks * (i + 1) / pool->nb_threads);
+    for (int task = last - 1; task >= first; task--) {
+      deque_push(&pool->deques[i], task);
+    }
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->func = func;
+  pool->arg = arg;
+  atomic_store(&pool->nb_queued, nb_tasks);
+  atomic_store(&pool->nb_pending, nb_tasks);
+  pool->nb_active = 1;
+  pool->job++;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  threadpool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->nb_active > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  pool->nb_jobs++;
+  pool->elapsed += threadpool_time() - start;
+}
+
+/* Function run once by worker `worker`, see threadpool_each() */
+typedef void (*worker_func_t)(void *arg, const int worker);
+
+typedef struct threadpool_each_t {
+  worker_func_t func;
+  void *arg;
+  int nb_threads;
+  int nb_done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} threadpool_each_t;
+
+static void threadpool_each_task(void *arg, const int task, const int worker) {
+  (void) task;
+  threadpool_each_t *each = (threadpool_each_t *) arg;
+  each->func(each->arg, worker);
+
+  /* Hold the worker until all ran `func`, so no worker takes two tasks */
+  pthread_mutex_lock(&each->lock);
+  each->nb_done++;
+  pthread_cond_broadcast(&each->cond);
+  while (each->nb_done < each->nb_threads) {
+    pthread_cond_wait(&each->cond, &each->lock);
+  }
+  pthread_mutex_unlock(&each->lock);
+}
+
+/**
+ * Run `func` exactly once on every worker of `pool`, including the calling
+ * thread, for work that depends on the thread it runs on rather than on a
+ * task, e.g. pinning or first touching memory.
+ */
+void threadpool_each(threadpool_t *pool, worker_func_t func, void *arg) {
+  threadpool_each_t each;
+  each.func = func;
+  each.arg = arg;
+  each.nb_threads = pool->nb_threads;
+  each.nb_done = 0;
+  pthread_mutex_init(&each.lock, NULL);
+  pthread_cond_init(&each.cond, NULL);
+
+  threadpool_run(pool, threadpool_each_task, &each, pool->nb_threads);
+
+  pthread_cond_destroy(&each.cond);
+  pthread_mutex_destroy(&each.lock);
+}
+
+/* Print per worker statistics, utilisation is the share of the time spent in
+ * threadpool_run() a worker spent running tasks */
+void threadpool_stats_print(const threadpool_t *pool) {
+  printf("pool.threads: %d\n", pool->nb_threads);
+  printf("pool.jobs: %ld\n", pool->nb_jobs);
+  printf("pool.elapsed: %f\n", pool->elapsed);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    const threadpool_stats_t *stats = &pool->stats[i];
+    printf("pool.worker[%d]: tasks=%ld steals=%ld failed_steals=%ld ",
+           i, stats->tasks, stats->steals, stats->failed_steals);
+    printf("busy=%f utilisation=%f\n",
+           stats->busy, (pool->elapsed > 0.0) ? stats->busy / pool->elapsed : 0.0);
+  }
+}
+
+/**
+ * Population evaluation job. Trees are grouped into chunks of about the same
+ * total program size and rows into blocks of EVAL_BLOCK_TILES tiles, a task
+ * evaluates one chunk on one block, so a tree that dominates the evaluation
+ * cost is spread over as many tasks as there are blocks.
+ */
+typedef struct population_job_t {
+  tree_t **trees;
+  int nb_trees;
+  int *chunks; /* Chunk `c` is trees [chunks[c], chunks[c + 1]) */
+  int nb_chunks;
+
+  const dataset_t *ds;
+  const dataset_t *const *local; /* Replica of `ds` each worker reads, or NULL */
+  int tile_rows;
+  int block_rows;
+  int nb_blocks;
+  double max_score;
+
+  /* Per block and tree, block `b` of tree `i` at `b * nb_trees + i` */
+  double *err_sq;
+  int *dominated;
+} population_job_t;
+
+static void population_job_setup(population_job_t *job,
+                                 tree_t **trees,
+                                 const int nb_trees,
+                                 const dataset_t *ds,
+                                 const double max_score) {
+  job->trees = trees;
+  job->nb_trees = nb_trees;
+  job->chunks = NULL;
+  job->nb_chunks = 0;
+  job->ds = ds;
+  job->local = NULL;
+  job->tile_rows = eval_ctx_default()->tile_rows;
+  job->block_rows = evaluate_block_rows(eval_ctx_default(), ds);
+  job->nb_blocks = (ds->nb_rows + job->block_rows - 1) / job->block_rows;
+  job->max_score = max_score;
+  job->err_sq = (double *) malloc(sizeof(double) * job->nb_blocks * nb_trees);
+  job->dominated = (int *) malloc(sizeof(int) * job->nb_blocks * nb_trees);
+}
+
+/* Clear the per block sums of trees [`start`, `end`) before evaluating them */
+static void population_job_reset(population_job_t *job, const int start, const int end) {
+  for (int b = 0; b < job->nb_blocks; b++) {
+    for (int i = start; i < end; i++) {
+      const int k = b * job->nb_trees + i;
+      job->err_sq[k] = 0.0;
+      job->dominated[k] = (evaluate_score_bound(job->trees[i], job->ds, 0.0) > job->max_score);
+    }
+  }
+}
+
+/* Reduce the per block sums in block order into errors and scores */
+static void population_job_finish(population_job_t *job) {
+  for (int i = 0; i < job->nb_trees; i++) {
+    double err_sq = 0.0;
+    int dominated = 0;
+    for (int b = 0; b < job->nb_blocks; b++) {
+      err_sq += job->err_sq[b * job->nb_trees + i];
+      dominated |= job->dominated[b * job->nb_trees + i];
+    }
+    dominated |= (evaluate_score_bound(job->trees[i], job->ds, err_sq) > job->max_score);
+    evaluate_score(job->trees[i], job->ds, err_sq, dominated);
+  }
+
+  free(job->dominated);
+  free(job->err_sq);
+  free(job->chunks);
+}
+
+static void population_evaluate_task(void *arg, const int task, const int worker) {
+  const population_job_t *job = (const population_job_t *) arg;
+  const dataset_t *ds = (job->local) ? job->local[worker] : job->ds;
+  const int chunk = task % job->nb_chunks;
+  const int block = task / job->nb_chunks;
+  const int start = job->chunks[chunk];
+  const int nb_trees = job->chunks[chunk + 1] - start;
+  const int row = block * job->block_rows;
+  const int nb_rows = MIN(job->block_rows, job->ds->nb_rows - row);
+  const int offset = block * job->nb_trees + start;
+
+  eval_ctx_t *ctx = eval_ctx_default();
+  ctx->tile_rows = job->tile_rows;
+  evaluate_reserve(ctx, job->trees + start, nb_trees, ds);
+  evaluate_block(ctx, job->trees + start, nb_trees, ds, row, nb_rows,
+                 job->max_score, job->err_sq + offset, job->dominated + offset);
+}
+
+static int population_evaluate_local(threadpool_t *pool,
+                                     tree_t **trees,
+                                     const int nb_trees,
+                                     const dataset_t *ds,
+                                     const dataset_t *const *local,
+                                     const double max_score) {
+  if (nb_trees == 0) {
+    return 0;
+  }
+  evaluate_compile(trees, nb_trees);
+
+  population_job_t job;
+  population_job_setup(&job, trees, nb_trees, ds, max_score);
+  job.local = local;
+  population_job_reset(&job, 0, nb_trees);
+
+  /* A few tasks per thread to balance trees of different sizes */
+  const int nb_tasks = pool->nb_threads * 8;
+  const int nb_chunks = MAX(1, MIN(nb_trees, (nb_tasks + job.nb_blocks - 1) / job.nb_blocks));
+  long cost = 0;
+  for (int i = 0; i < nb_trees; i++) {
+    cost += trees[i]->program->size;
+  }
+  job.chunks = (int *) malloc(sizeof(int) * (nb_chunks + 1));
+  job.chunks[0] = 0;
+  job.nb_chunks = 0;
+  long chunk_cost = 0;
+  for (int i = 0; i < nb_trees; i++) {
+    chunk_cost += trees[i]->program->size;
+    if (chunk_cost * nb_chunks >= cost * (job.nb_chunks + 1) || i == nb_trees - 1) {
+      job.chunks[++job.nb_chunks] = i + 1;
+    }
+  }
+
+  /* Evaluate */
+  threadpool_run(pool, population_evaluate_task, &job, job.nb_chunks * job.nb_blocks);
+  population_job_finish(&job);
+
+  return 0;
+}
+
+/**
+ * Evaluate `nb_trees` trees on dataset `ds` with the threads of `pool`,
+ * stopping early for trees that cannot score below `max_score`.
+ *
+ * Tasks evaluate a chunk of trees on a block of rows with each thread's
+ * default context, so scratch buffers are per thread and kept between
+ * generations. Every thread uses the tile size of the calling thread's
+ * default context and block sums are added in block order, so a tree's error
+ * is the same as with population_evaluate_ctx() whatever the number of
+ * threads. Only the bound differs on datasets of more than one block: a task
+ * only sees its own block, so a tree is dominated once the rows of one block
+ * alone show it cannot score below `max_score`.
+ */
+int population_evaluate_pool(threadpool_t *pool,
+                             tree_t **trees,
+                             const int nb_trees,
+                             const dataset_t *ds,
+                             const double max_score) {
+  return population_evaluate_local(pool, trees, nb_trees, ds, NULL, max_score);
+}
+
+/* Trees per slice of the next generation, see population_vary() */
+#define VARY_SLICE_TREES 64
+
+/**
+ * Variation job. The next generation is split into slices of
+ * VARY_SLICE_TREES trees, each bred with its own random stream: trees are
+ * selected by tournament from the current generation, which is only read,
+ * copied into the slice, then pairs of the slice are crossed over and trees
+ * mutated.
+ *
+ * Offspring are packed, and variation works on the packed nodes, unless
+ * they keep node outputs: a generation evaluated with
+ * population_evaluate_incremental() stays unpacked so its offspring share
+ * the outputs of the subtrees variation left alone.
+ */
+typedef struct vary_job_t {
+  tree_t **trees;
+  tree_t **next;
+  int nb_trees;
+  int in_place; /* Winners are assigned to the trees of `next` */
+  rng_t *rngs;  /* One per slice */
+
+  const function_set_t *fs;
+  const terminal_set_t *ts;
+  int t_size;
+  double crossover_rate;
+  double mutation_rate;
+} vary_job_t;
+
+static void vary_job_setup(vary_job_t *job,
+                           rng_t *rng,
+                           tree_t **trees,
+                           tree_t **next,
+                           rng_t *rngs,
+                           const int nb_trees,
+                           const function_set_t *fs,
+                           const terminal_set_t *ts,
+                           const int t_size,
+                           const double crossover_rate,
+                           const double mutation_rate) {
+  const int nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  job->trees = trees;
+  job->next = next;
+  job->nb_trees = nb_trees;
+  job->in_place = 0;
+  job->rngs = rngs;
+  for (int i = 0; i < nb_slices; i++) {
+    job->rngs[i] = rng_split(rng);
+  }
+  job->fs = fs;
+  job->ts = ts;
+  job->t_size = t_size;
+  job->crossover_rate = crossover_rate;
+  job->mutation_rate = mutation_rate;
+}
+
+static void vary_slice_task(void *arg, const int slice, const int worker) {
+  (void) worker;
+  const vary_job_t *job = (const vary_job_t *) arg;
+  rng_t *rng = &job->rngs[slice];
+  const int start = slice * VARY_SLICE_TREES;
+  const int end = MIN(start + VARY_SLICE_TREES, job->nb_trees);
+
+  /* Selection */
+  for (int i = start; i < end; i++) {
+    const tree_t *winner = tournament(rng, job->trees, job->nb_trees, job->t_size);
+    if (job->in_place) {
+      tree_assign(job->next[i], winner);
+    } else {
+      job->next[i] = tree_copy(winner);
+    }
+  }
+
+  /* Crossover */
+  for (int i = start; i + 1 < end; i += 2) {
+    if (randf(rng, 0.0, 1.0) < job->crossover_rate) {
+      point_crossover(rng, job->next[i], job->next[i + 1]);
+    }
+  }
+
+  /* Mutate, then pack trees that keep no node outputs */
+  for (int i = start; i < end; i++) {
+    if (randf(rng, 0.0, 1.0) < job->mutation_rate) {
+      subtree_mutation(rng, job->fs, job->ts, job->next[i]);
+    }
+    if (job->next[i]->ds_generation == 0) {
+      tree_pack(job->next[i]);
+    }
+  }
+}
+
+static void vary_delete_task(void *arg, const int slice, const int worker) {
+  (void) worker;
+  const vary_job_t *job = (const vary_job_t *) arg;
+  const int start = slice * VARY_SLICE_TREES;
+  const int end = MIN(start + VARY_SLICE_TREES, job->nb_trees);
+  for (int i = start; i < end; i++) {
+    tree_delete(job->trees[i]);
+  }
+}
+
+/**
+ * Breed the next generation of `nb_trees` trees from `trees`: tournament
+ * selection of `t_size`, point crossover of consecutive pairs with
+ * probability `crossover_rate` and subtree mutation with probability
+ * `mutation_rate`. The current generation is deleted and the next returned.
+ *
+ * Every slice of the next generation draws from its own stream split from
+ * `rng`, so population_vary_pool() gives the same generation whatever the
+ * number of threads.
+ */
+tree_t **population_vary(rng_t *rng,
+                         tree_t **trees,
+                         const int nb_trees,
+                         const function_set_t *fs,
+                         const terminal_set_t *ts,
+                         const int t_size,
+                         const double crossover_rate,
+                         const double mutation_rate) {
+  const int nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  tree_t **next = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+  rng_t *rngs = (rng_t *) malloc(sizeof(rng_t) * nb_slices);
+  vary_job_t job;
+  vary_job_setup(&job, rng, trees, next, rngs, nb_trees, fs, ts, t_size,
+                 crossover_rate, mutation_rate);
+  for (int i = 0; i < nb_slices; i++) {
+    vary_slice_task(&job, i, 0);
+  }
+  for (int i = 0; i < nb_slices; i++) {
+    vary_delete_task(&job, i, 0);
+  }
+
+  free(job.rngs);
+  free(trees);
+  return job.next;
+}
+
+/**
+ * Breed the next generation with the threads of `pool`, slices run in
+ * parallel and the nodes each thread copies and deletes go through its own
+ * node cache. See population_vary().
+ */
+tree_t **population_vary_pool(threadpool_t *pool,
+                              rng_t *rng,
+                              tree_t **trees,
+                              const int nb_trees,
+                              const function_set_t *fs,
+                              const terminal_set_t *ts,
+                              const int t_size,
+                              const double crossover_rate,
+                              const double mutation_rate) {
+  const int nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  tree_t **next = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+  rng_t *rngs = (rng_t *) malloc(sizeof(rng_t) * nb_slices);
+  vary_job_t job;
+  vary_job_setup(&job, rng, trees, next, rngs, nb_trees, fs, ts, t_size,
+                 crossover_rate, mutation_rate);
+  threadpool_run(pool, vary_slice_task, &job, nb_slices);
+  threadpool_run(pool, vary_delete_task, &job, nb_slices);
+
+  free(job.rngs);
+  free(trees);
+  return job.next;
+}
+
+/**
+ * Pipelined generation. Breeding a slice of the next generation spawns the
+ * evaluation of that slice, one task per block of rows, so evaluation starts
+ * while other slices are still being bred. Once the last slice is bred
+ * nothing reads the current generation and breeding spawns its deletion,
+ * which overlaps the remaining evaluation.
+ */
+typedef struct evolve_job_t {
+  threadpool_t *pool;
+  vary_job_t vary;
+  population_job_t eval;
+  int nb_slices;
+  atomic_int nb_breeding; /* Slices not bred yet */
+} evolve_job_t;
+
+static void evolve_task(void *arg, const int task, const int worker) {
+  evolve_job_t *job = (evolve_job_t *) arg;
+  const int nb_slices = job->nb_slices;
+  const int nb_evals = nb_slices * job->eval.nb_blocks;
+
+  /* Evaluate a slice on a block, chunks of the evaluation are the slices */
+  if (task >= nb_slices && task < nb_slices + nb_evals) {
+    population_evaluate_task(&job->eval, task - nb_slices, worker);
+    return;
+  }
+
+  /* Delete a slice of the current generation */
+  if (task >= nb_slices + nb_evals) {
+    vary_delete_task(&job->vary, task - nb_slices - nb_evals, worker);
+    return;
+  }
+
+  /* Breed a slice and queue its evaluation, first block on top */
+  const int start = task * VARY_SLICE_TREES;
+  const int end = MIN(start + VARY_SLICE_TREES, job->vary.nb_trees);
+  vary_slice_task(&job->vary, task, worker);
+  evaluate_compile(job->vary.next + start, end - start);
+  population_job_reset(&job->eval, start, end);
+  for (int b = job->eval.nb_blocks - 1; b >= 0; b--) {
+    threadpool_spawn(job->pool, worker, nb_slices + b * nb_slices + task);
+  }
+
+  if (atomic_fetch_sub(&job->nb_breeding, 1) == 1) {
+    for (int i = 0; i < nb_slices; i++) {
+      threadpool_spawn(job->pool, worker, nb_slices + nb_evals + i);
+    }
+  }
+}
+
+/**
+ * Breed and evaluate the next generation of the evaluated generation `trees`
+ * in one job on `pool`, see population_vary() and population_evaluate_pool()
+ * for the parameters. The current generation is deleted and the next
+ * returned, evaluated and bounded by `max_score`.
+ *
+ * Compared to evaluating, selecting and mutating in turn, breeding overlaps
+ * evaluation and deletion, and the generation ends with one barrier instead
+ * of three. The barrier stays: a tournament may draw any tree of the current
+ * generation, so breeding cannot start before all of it is evaluated. The
+ * result is the same as population_vary() followed by
+ * population_evaluate_pool() with the same random stream.
+ */
+tree_t **population_evolve_pool(threadpool_t *pool,
+                                rng_t *rng,
+                                tree_t **trees,
+                                const int nb_trees,
+                                const function_set_t *fs,
+                                const terminal_set_t *ts,
+                                const dataset_t *ds,
+                                const int t_size,
+                                const double crossover_rate,
+                                const double mutation_rate,
+                                const double max_score) {
+  evolve_job_t job;
+  job.pool = pool;
+  job.nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  atomic_init(&job.nb_breeding, job.nb_slices);
+  tree_t **next = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+  rng_t *rngs = (rng_t *) malloc(sizeof(rng_t) * job.nb_slices);
+  vary_job_setup(&job.vary, rng, trees, next, rngs, nb_trees, fs, ts, t_size,
+                 crossover_rate, mutation_rate);
+
+  population_job_setup(&job.eval, job.vary.next, nb_trees, ds, max_score);
+  job.eval.nb_chunks = job.nb_slices;
+  job.eval.chunks = (int *) malloc(sizeof(int) * (job.nb_slices + 1));
+  for (int i = 0; i <= job.nb_slices; i++) {
+    job.eval.chunks[i] = MIN(i * VARY_SLICE_TREES, nb_trees);
+  }
+
+  threadpool_run(pool, evolve_task, &job, job.nb_slices);
+  population_job_finish(&job.eval);
+
+  free(job.vary.rngs);
+  free(trees);
+  return job.vary.next;
+}
+
+/**
+ * Double buffered population. The trees of both generations live in one
+ * array allocated once: breeding assigns the winners of the tournaments to
+ * the trees of the back generation, then the two generations swap, so the
+ * trees themselves are never allocated again. A tree keeps the node array
+ * and program it held alone as spares (see tree_assign()), but a tree of
+ * the back generation mostly held nodes and a program shared with the
+ * offspring copied from it. A varied offspring then still gets a new node
+ * array from tree_own() and a new program when it is evaluated, about one
+ * of each per offspring and generation.
+ */
+typedef struct population_t {
+  tree_t **trees; /* Current generation */
+  tree_t **next;  /* Back generation, overwritten by population_breed() */
+  tree_t *storage;
+  int nb_trees;
+  rng_t *rngs; /* One per slice */
+  long generation;
+} population_t;
+
+/**
+ * Create a population from generation `trees` of `nb_trees` trees. The
+ * trees are moved into the population and packed, `trees` is freed.
+ */
+population_t *population_new(tree_t **trees, const int nb_trees) {
+  const int nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  population_t *pop = (population_t *) malloc(sizeof(population_t));
+  pop->trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees * 2);
+  pop->next = pop->trees + nb_trees;
+  pop->storage = (tree_t *) malloc(sizeof(tree_t) * nb_trees * 2);
+  pop->nb_trees = nb_trees;
+  pop->rngs = (rng_t *) malloc(sizeof(rng_t) * nb_slices);
+  pop->generation = 0;
+
+  for (int i = 0; i < nb_trees; i++) {
+    pop->storage[i] = *trees[i];
+    free(trees[i]);
+    tree_pack(&pop->storage[i]);
+    tree_init(&pop->storage[nb_trees + i]);
+    pop->trees[i] = &pop->storage[i];
+    pop->next[i] = &pop->storage[nb_trees + i];
+  }
+  free(trees);
+
+  return pop;
+}
+
+void population_delete(population_t *pop) {
+  for (int i = 0; i < pop->nb_trees * 2; i++) {
+    tree_clear(&pop->storage[i]);
+  }
+  /* The two generations share one array, starting at the lower pointer */
+  free((pop->trees < pop->next) ? pop->trees : pop->next);
+  free(pop->storage);
+  free(pop->rngs);
+  free(pop);
+}
+
+/**
+ * Breed the next generation of population `pop` in its back generation and
+ * make it current, with the threads of `pool` or serially if `pool` is NULL.
+ * The result is the same as population_vary() with the same parameters.
+ */
+void population_breed(population_t *pop,
+                      threadpool_t *pool,
+                      rng_t *rng,
+                      const function_set_t *fs,
+                      const terminal_set_t *ts,
+                      const int t_size,
+                      const double crossover_rate,
+                      const double mutation_rate) {
+  const int nb_trees = pop->nb_trees;
+  const int nb_slices = (nb_trees + VARY_SLICE_TREES - 1) / VARY_SLICE_TREES;
+  vary_job_t job;
+  vary_job_setup(&job, rng, pop->trees, pop->next, pop->rngs, nb_trees,
+                 fs, ts, t_size, crossover_rate, mutation_rate);
+  job.in_place = 1;
+  if (pool) {
+    threadpool_run(pool, vary_slice_task, &job, nb_slices);
+  } else {
+    for (int i = 0; i < nb_slices; i++) {
+      vary_slice_task(&job, i, 0);
+    }
+  }
+
+  tree_t **trees = pop->trees;
+  pop->trees = pop->next;
+  pop->next = trees;
+  pop->generation++;
+}
+
+/******************************************************************************
+ *                                   NUMA
+ ******************************************************************************/
+
+#define NUMA_MAX_NODES 64
+
+/**
+ * NUMA topology, read from /sys/devices/system/node. Machines without it
+ * are one node holding every CPU. CPUs outside the affinity of the process
+ * are left out.
+ */
+typedef struct numa_t {
+  int nb_nodes;
+  int nb_cpus;
+  int *cpu_node; /* Node of each CPU, -1 if not online */
+} numa_t;
+
+/* Assign the CPUs in list `s`, e.g. "0-3,8-11", to node `node` */
+static void numa_parse_cpus(numa_t *numa, const char *s, const int node) {
+  char *end = NULL;
+  while (*s) {
+    const long first = strtol(s, &end, 10);
+    if (end == s) {
+      break;
+    }
+    long last = first;
+    s = end;
+    if (*s == '-') {
+      last = strtol(s + 1, &end, 10);
+      s = end;
+    }
+    for (long cpu = first; cpu <= last && cpu < numa->nb_cpus; cpu++) {
+      numa->cpu_node[cpu] = node;
+    }
+    if (*s == ',') {
+      s++;
+    } else {
+      break;
+    }
+  }
+}
+
+numa_t *numa_detect() {
+  numa_t *numa = (numa_t *) malloc(sizeof(numa_t));
+  numa->nb_nodes = 0;
+  numa->nb_cpus = MAX(1, (int) sysconf(_SC_NPROCESSORS_CONF));
+  numa->cpu_node = (int *) malloc(sizeof(int) * numa->nb_cpus);
+  for (int cpu = 0; cpu < numa->nb_cpus; cpu++) {
+    numa->cpu_node[cpu] = -1;
+  }
+
+  for (int node = 0; node < NUMA_MAX_NODES; node++) {
+    char path[128];
+    char cpus[4096];
+    snprintf(path, 128, "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+      continue;
+    }
+    if (fgets(cpus, 4096, fp)) {
+      numa_parse_cpus(numa, cpus, node);
+      numa->nb_nodes = node + 1;
+    }
+    fclose(fp);
+  }
+
+  /* No topology, one node */
+  if (numa->nb_nodes == 0) {
+    const int nb_online = MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+    for (int cpu = 0; cpu < MIN(nb_online, numa->nb_cpus); cpu++) {
+      numa->cpu_node[cpu] = 0;
+    }
+    numa->nb_nodes = 1;
+  }
+
+  /* Only the CPUs the process may run on, e.g. under taskset or a cpuset */
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0) {
+    for (int cpu = 0; cpu < numa->nb_cpus; cpu++) {
+      if (cpu >= CPU_SETSIZE || CPU_ISSET(cpu, &allowed) == 0) {
+        numa->cpu_node[cpu] = -1;
+      }
+    }
+  }
+
+  return numa;
+}
+
+void numa_delete(numa_t *numa) {
+  free(numa->cpu_node);
+  free(numa);
+}
+
+/* Pin the calling thread to CPU `cpu`, returns -1 on error */
+int thread_pin(const int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return -1;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+/**
+ * Fraction of the pages of [`addr`, `addr + size`) that are on node `node`,
+ * -1 if the kernel cannot tell.
+ */
+double numa_pages_local(const void *addr, const size_t size, const int node) {
+#ifndef SYS_move_pages
+  (void) addr;
+  (void) size;
+  (void) node;
+  return -1.0;
+#else
+  const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  const uintptr_t first = (uintptr_t) addr / page * page;
+  const uintptr_t last = ((uintptr_t) addr + size + page - 1) / page * page;
+
+  void *pages[256];
+  int status[256];
+  long nb_pages = 0;
+  long nb_local = 0;
+  for (uintptr_t p = first; p < last;) {
+    long n = 0;
+    for (; n < 256 && p < last; n++, p += page) {
+      pages[n] = (void *) p;
+    }
+    if (syscall(SYS_move_pages, 0, (unsigned long) n, pages, NULL, status, 0) != 0) {
+      return -1.0;
+    }
+    for (long i = 0; i < n; i++) {
+      nb_local += (status[i] == node);
+    }
+    nb_pages += n;
+  }
+
+  return (nb_pages) ? (double) nb_local / nb_pages : 1.0;
+#endif
+}
+
+static void threadpool_pin_worker(void *arg, const int worker) {
+  threadpool_t *pool = (threadpool_t *) arg;
+  if (thread_pin(pool->cpus[worker]) != 0) {
+    pool->cpus[worker] = -1;
+  }
+}
+
+/**
+ * Pin the workers of `pool` to CPUs, going round the nodes of `numa` so a
+ * pool smaller than the machine still uses the memory of every node. Worker 0
+ * is the calling thread: its affinity is saved and restored by
+ * threadpool_delete(), threads it creates meanwhile inherit its CPU.
+ * Returns the number of workers pinned.
+ */
+int threadpool_pin(threadpool_t *pool, const numa_t *numa) {
+  if (pool->affinity == NULL) {
+    pool->affinity = (cpu_set_t *) malloc(sizeof(cpu_set_t));
+    if (sched_getaffinity(0, sizeof(cpu_set_t), pool->affinity) != 0) {
+      free(pool->affinity);
+      pool->affinity = NULL;
+    }
+  }
+
+  /* CPUs ordered by their rank in their node, then by node */
+  int *order = (int *) malloc(sizeof(int) * numa->nb_cpus);
+  int nb_order = 0;
+  for (int rank = 0; nb_order < numa->nb_cpus; rank++) {
+    const int nb_before = nb_order;
+    for (int node = 0; node < numa->nb_nodes; node++) {
+      int k = 0;
+      for (int cpu = 0; cpu < numa->nb_cpus; cpu++) {
+        if (numa->cpu_node[cpu] == node && k++ == rank) {
+          order[nb_order++] = cpu;
+          break;
+        }
+      }
+    }
+    if (nb_order == nb_before) {
+      break;
+    }
+  }
+  if (nb_order == 0) {
+    free(order);
+    return 0;
+  }
+
+  for (int i = 0; i < pool->nb_threads; i++) {
+    pool->cpus[i] = order[i % nb_order];
+  }
+  free(order);
+  threadpool_each(pool, threadpool_pin_worker, pool);
+
+  int nb_pinned = 0;
+  for (int i = 0; i < pool->nb_threads; i++) {
+    pool->nodes[i] = (pool->cpus[i] >= 0) ? numa->cpu_node[pool->cpus[i]] : 0;
+    nb_pinned += (pool->cpus[i] >= 0);
+  }
+
+  return nb_pinned;
+}
+
+/**
+ * Copies of a dataset's columns, one per NUMA node that has workers of the
+ * pool it was made for. The columns of a node's replica are allocated and
+ * first touched by workers pinned to that node, so the kernel places their
+ * pages there.
+ */
+typedef struct dataset_replicas_t {
+  int nb_nodes;
+  dataset_t **nodes;         /* Replica of each node, NULL if it has no workers */
+  const dataset_t **workers; /* Replica each worker reads */
+  int *nb_workers;           /* Workers on each node */
+  double *local;             /* Fraction of the replica's pages on its node */
+  double *bandwidth;         /* Read bandwidth of each node in GB/s */
+} dataset_replicas_t;
+
+typedef struct dataset_replicate_job_t {
+  threadpool_t *pool;
+  dataset_replicas_t *replicas;
+  const dataset_t *ds;
+  double *bandwidth; /* Per worker */
+} dataset_replicate_job_t;
+
+/* Copy this worker's share of the columns of its node's replica */
+static void dataset_replicate_worker(void *arg, const int worker) {
+  dataset_replicate_job_t *job = (dataset_replicate_job_t *) arg;
+  const int node = job->pool->nodes[worker];
+  int rank = 0;
+  for (int i = 0; i < worker; i++) {
+    rank += (job->pool->nodes[i] == node);
+  }
+
+  dataset_t *replica = job->replicas->nodes[node];
+  const size_t size = sizeof(double) * job->ds->nb_rows;
+  for (int j = rank; j < job->ds->nb_cols; j += job->replicas->nb_workers[node]) {
+    replica->data[j] = (double *) mem_alloc(size, "dataset replica column");
+    memcpy(replica->data[j], job->ds->data[j], sizeof(double) * job->ds->nb_rows);
+  }
+}
+
+/* Time a pass over this worker's local replica */
+static void dataset_replicate_read(void *arg, const int worker) {
+  dataset_replicate_job_t *job = (dataset_replicate_job_t *) arg;
+  const dataset_t *replica = job->replicas->workers[worker];
+
+  const double start = threadpool_time();
+  double sum = 0.0;
+  for (int j = 0; j < replica->nb_cols; j++) {
+    for (int i = 0; i < replica->nb_rows; i++) {
+      sum += replica->data[j][i];
+    }
+  }
+  volatile double sink = sum; /* Keep the pass */
+  (void) sink;
+  const double elapsed = threadpool_time() - start;
+
+  const double bytes = sizeof(double) * (double) replica->nb_rows * replica->nb_cols;
+  job->bandwidth[worker] = (elapsed > 0.0) ? bytes / elapsed * 1e-9 : 0.0;
+}
+
+/**
+ * Replicate the columns of `ds` on every node with workers of `pool`, pin
+ * `pool` with threadpool_pin() first. An unpinned pool gets one replica.
+ */
+dataset_replicas_t *dataset_replicate(threadpool_t *pool,
+                                      const numa_t *numa,
+                                      const dataset_t *ds) {
+  dataset_replicas_t *replicas = (dataset_replicas_t *) malloc(sizeof(dataset_replicas_t));
+  replicas->nb_nodes = numa->nb_nodes;
+  replicas->nodes = (dataset_t **) calloc(numa->nb_nodes, sizeof(dataset_t *));
+  replicas->workers = (const dataset_t **) malloc(sizeof(dataset_t *) * pool->nb_threads);
+  replicas->nb_workers = (int *) calloc(numa->nb_nodes, sizeof(int));
+  replicas->local = (double *) calloc(numa->nb_nodes, sizeof(double));
+  replicas->bandwidth = (double *) calloc(numa->nb_nodes, sizeof(double));
+  for (int i = 0; i < pool->nb_threads; i++) {
+    replicas->nb_workers[pool->nodes[i]]++;
+  }
+
+  /* Replica headers, columns are allocated by the workers */
+  for (int node = 0; node < numa->nb_nodes; node++) {
+    if (replicas->nb_workers[node] == 0) {
+      continue;
+    }
+    dataset_t *replica = (dataset_t *) malloc(sizeof(dataset_t));
+    replica->nb_rows = ds->nb_rows;
+    replica->nb_cols = ds->nb_cols;
+    replica->data = (double **) malloc(sizeof(double *) * ds->nb_cols);
+    replica->fields = (char **) malloc(sizeof(char *) * ds->nb_cols);
+    for (int j = 0; j < ds->nb_cols; j++) {
+      replica->fields[j] = malloc_string(ds->fields[j]);
+    }
+    replica->predict = malloc_string(ds->predict);
+    replica->inputs = NULL;
+    replica->shm = NULL;
+    replica->shm_size = 0;
+    replicas->nodes[node] = replica;
+  }
+  for (int i = 0; i < pool->nb_threads; i++) {
+    replicas->workers[i] = replicas->nodes[pool->nodes[i]];
+  }
+
+  dataset_replicate_job_t job;
+  job.pool = pool;
+  job.replicas = replicas;
+  job.ds = ds;
+  job.bandwidth = (double *) calloc(pool->nb_threads, sizeof(double));
+  threadpool_each(pool, dataset_replicate_worker, &job);
+
+  /* Placement, then bandwidth with every worker reading at once */
+  for (int node = 0; node < numa->nb_nodes; node++) {
+    dataset_t *replica = replicas->nodes[node];
+    if (replica == NULL) {
+      continue;
+    }
+    dataset_bind(replica);
+    for (int j = 0; j < replica->nb_cols; j++) {
+      const size_t size = sizeof(double) * replica->nb_rows;
+      const double local = numa_pages_local(replica->data[j], size, node);
+      if (local < 0.0) {
+        replicas->local[node] = -1.0;
+        break;
+      }
+      replicas->local[node] += local / replica->nb_cols;
+    }
+  }
+  threadpool_each(pool, dataset_replicate_read, &job);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    replicas->bandwidth[pool->nodes[i]] += job.bandwidth[i];
+  }
+  free(job.bandwidth);
+
+  return replicas;
+}
+
+void dataset_replicas_delete(dataset_replicas_t *replicas) {
+  for (int node = 0; node < replicas->nb_nodes; node++) {
+    if (replicas->nodes[node]) {
+      dataset_delete(replicas->nodes[node]);
+    }
+  }
+  free(replicas->nodes);
+  free(replicas->workers);
+  free(replicas->nb_workers);
+  free(replicas->local);
+  free(replicas->bandwidth);
+  free(replicas);
+}
+
+/* Print the workers, pages on node and read bandwidth of every replica */
+void dataset_replicas_print(const dataset_replicas_t *replicas) {
+  printf("replicas.nodes: %d\n", replicas->nb_nodes);
+  for (int node = 0; node < replicas->nb_nodes; node++) {
+    const dataset_t *replica = replicas->nodes[node];
+    if (replica == NULL) {
+      continue;
+    }
+    const double mb = sizeof(double) * (double) replica->nb_rows * replica->nb_cols / (1024.0 * 1024.0);
+    printf("replicas.node[%d]: workers=%d size=%.1fMB ", node, replicas->nb_workers[node], mb);
+    if (replicas->local[node] < 0.0) {
+      printf("local=unknown ");
+    } else {
+      printf("local=%.1f%% ", replicas->local[node] * 100.0);
+    }
+    printf("bandwidth=%.2fGB/s\n", replicas->bandwidth[node]);
+  }
+}
+
+/**
+ * Same as population_evaluate_pool(), with every worker reading the replica
+ * of its own node. `replicas` must have been made for `pool`.
+ */
+int population_evaluate_replicas(threadpool_t *pool,
+                                 tree_t **trees,
+                                 const int nb_trees,
+                                 const dataset_replicas_t *replicas,
+                                 const double max_score) {
+  return population_evaluate_local(pool, trees, nb_trees, replicas->workers[0],
+                                   replicas->workers, max_score);
+}
+
+/******************************************************************************
+ *                                 ISLANDS
+ ******************************************************************************/
+
+/* Migration topologies */
+#define RING_TOPOLOGY 0
+#define FULL_TOPOLOGY 1
+
+/* Capacity of a migration queue */
+#define MIGRATION_QUEUE_SIZE 64
+
+/**
+ * Lock-free single producer, single consumer ring buffer. The producer only
+ * writes `tail` and the consumer only writes `head`, each on its own cache
+ * line, so pushing and popping never wait on the other side.
+ */
+typedef struct spsc_queue_t {
+  void **slots;
+  unsigned capacity;
+  _Alignas(64) atomic_uint head; /* Next slot to pop */
+  _Alignas(64) atomic_uint tail; /* Next slot to push */
+} spsc_queue_t;
+
+spsc_queue_t *spsc_queue_new(const unsigned capacity) {
+  spsc_queue_t *q = (spsc_queue_t *) aligned_alloc(64, sizeof(spsc_queue_t));
+  q->slots = (void **) malloc(sizeof(void *) * capacity);
+  q->capacity = capacity;
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  return q;
+}
+
+void spsc_queue_delete(spsc_queue_t *q) {
+  free(q->slots);
+  free(q);
+}
+
+/* Push `item`, returns -1 if the queue is full */
+int spsc_queue_push(spsc_queue_t *q, void *item) {
+  const unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  const unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (tail - head == q->capacity) {
+    return -1;
+  }
+  q->slots[tail % q->capacity] = item;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 0;
+}
+
+/* Pop the oldest item, NULL if the queue is empty */
+void *spsc_queue_pop(spsc_queue_t *q) {
+  const unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  const unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head == tail) {
+    return NULL;
+  }
+  void *item = q->slots[head % q->capacity];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return item;
+}
+
+/**
+ * Subpopulation evolved by one thread. Migrants are sent to the `out` queues
+ * and received from the `in` queues, one queue per pair of islands the
+ * topology connects.
+ */
+typedef struct island_t {
+  tree_t **trees;
+  int nb_trees;
+  rng_t rng;
+  double max_score;
+  int generation;
+
+  spsc_queue_t **out;
+  int nb_out;
+  spsc_queue_t **in;
+  int nb_in;
+
+  long nb_sent;
+  long nb_received;
+  long nb_dropped; /* Migrants not sent because the queue was full */
+} island_t;
+
+/**
+ * Island model. Each island evolves its own population, and every
+ * `migration_interval` generations copies of its `nb_migrants` best trees
+ * migrate to the neighbouring islands, where they replace the worst trees.
+ * Islands synchronise at migration points: all of them reach the point, all
+ * send, then all receive, so every migrant sent is received at the same
+ * migration and a run is reproducible whatever the number of threads.
+ */
+typedef struct islands_t {
+  island_t *islands;
+  int nb_islands;
+  int topology;
+  spsc_queue_t **queues;
+  int nb_queues;
+
+  const function_set_t *fs;
+  const terminal_set_t *ts;
+  const dataset_t *ds;
+
+  /* Settings, defaults set by islands_new() */
+  int migration_interval;
+  int nb_migrants;
+  int t_size;
+  double crossover_rate;
+  double mutation_rate;
+} islands_t;
+
+/**
+ * Create `nb_islands` islands of `nb_trees` random trees of at most
+ * `max_depth`, connected by `topology`. Each island draws from its own
+ * stream split from `rng`.
+ */
+islands_t *islands_new(rng_t *rng,
+                       const function_set_t *fs,
+                       const terminal_set_t *ts,
+                       const dataset_t *ds,
+                       const int nb_islands,
+                       const int nb_trees,
+                       const int max_depth,
+                       const int topology) {
+  islands_t *islands = (islands_t *) malloc(sizeof(islands_t));
+  islands->nb_islands = nb_islands;
+  islands->topology = topology;
+  islands->fs = fs;
+  islands->ts = ts;
+  islands->ds = ds;
+  islands->migration_interval = 10;
+  islands->nb_migrants = 2;
+  islands->t_size = MAX(2, (int) (nb_trees * 0.01));
+  islands->crossover_rate = 0.0;
+  islands->mutation_rate = 0.2;
+
+  /* Register inputs here, islands only look them up */
+  for (int i = 0; i < ts->length; i++) {
+    if (ts->terms[i].type == INPUT) {
+      input_id(ts->terms[i].str);
+    }
+  }
+
+  /* Islands */
+  islands->islands = (island_t *) malloc(sizeof(island_t) * nb_islands);
+  for (int i = 0; i < nb_islands; i++) {
+    island_t *island = &islands->islands[i];
+    island->rng = rng_split(rng);
+    island->nb_trees = nb_trees;
+    island->trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+    for (int j = 0; j < nb_trees; j++) {
+      island->trees[j] = tree_generate(&island->rng, GROW, fs, ts, max_depth);
+    }
+    island->max_score = INFINITY;
+    island->generation = 0;
+    island->out = (spsc_queue_t **) malloc(sizeof(spsc_queue_t *) * nb_islands);
+    island->nb_out = 0;
+    island->in = (spsc_queue_t **) malloc(sizeof(spsc_queue_t *) * nb_islands);
+    island->nb_in = 0;
+    island->nb_sent = 0;
+    island->nb_received = 0;
+    island->nb_dropped = 0;
+  }
+
+  /* One queue per connected pair, from island i to island j */
+  islands->queues = (spsc_queue_t **) malloc(sizeof(spsc_queue_t *) * nb_islands * nb_islands);
+  islands->nb_queues = 0;
+  for (int i = 0; i < nb_islands; i++) {
+    for (int j = 0; j < nb_islands; j++) {
+      int connected = 0;
+      if (topology == RING_TOPOLOGY) {
+        connected = (j == (i + 1) % nb_islands && j != i);
+      } else if (topology == FULL_TOPOLOGY) {
+        connected = (j != i);
+      } else {
+        FATAL("Opps! Topology not implemented [%d]\n", topology);
+      }
+      if (connected == 0) {
+        continue;
+      }
+
+      spsc_queue_t *q = spsc_queue_new(MIGRATION_QUEUE_SIZE);
+      islands->queues[islands->nb_queues++] = q;
+      islands->islands[i].out[islands->islands[i].nb_out++] = q;
+      islands->islands[j].in[islands->islands[j].nb_in++] = q;
+    }
+  }
+
+  return islands;
+}
+
+void islands_delete(islands_t *islands) {
+  for (int k = 0; k < islands->nb_queues; k++) {
+    tree_t *t;
+    while ((t = (tree_t *) spsc_queue_pop(islands->queues[k]))) {
+      tree_delete(t);
+    }
+    spsc_queue_delete(islands->queues[k]);
+  }
+  free(islands->queues);
+
+  for (int i = 0; i < islands->nb_islands; i++) {
+    island_t *island = &islands->islands[i];
+    for (int j = 0; j < island->nb_trees; j++) {
+      tree_delete(island->trees[j]);
+    }
+    free(island->trees);
+    free(island->out);
+    free(island->in);
+  }
+  free(islands->islands);
+  free(islands);
+}
+
+/* Send copies of the best trees of island `task` to its neighbours */
+static void island_send_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  const islands_t *islands = (const islands_t *) arg;
+  island_t *island = &islands->islands[task];
+  tree_t **trees = island->trees;
+  const int nb_migrants = MIN(islands->nb_migrants, island->nb_trees);
+
+  int migrants[MIGRATION_QUEUE_SIZE];
+  int nb_selected = 0;
+  for (int k = 0; k < nb_migrants && k < MIGRATION_QUEUE_SIZE; k++) {
+    int best = -1;
+    for (int i = 0; i < island->nb_trees; i++) {
+      int selected = 0;
+      for (int j = 0; j < nb_selected; j++) {
+        selected |= (migrants[j] == i);
+      }
+      if (selected == 0 && (best == -1 || tree_better(trees[i], trees[best]))) {
+        best = i;
+      }
+    }
+    migrants[nb_selected++] = best;
+  }
+  for (int q = 0; q < island->nb_out; q++) {
+    for (int k = 0; k < nb_selected; k++) {
+      tree_t *t = tree_copy(trees[migrants[k]]);
+      if (spsc_queue_push(island->out[q], t) != 0) {
+        tree_delete(t);
+        island->nb_dropped++;
+      } else {
+        island->nb_sent++;
+      }
+    }
+  }
+}
+
+/* Replace the worst trees of island `task` with the migrants sent to it */
+static void island_receive_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  const islands_t *islands = (const islands_t *) arg;
+  island_t *island = &islands->islands[task];
+  tree_t **trees = island->trees;
+
+  for (int q = 0; q < island->nb_in; q++) {
+    tree_t *t;
+    while ((t = (tree_t *) spsc_queue_pop(island->in[q]))) {
+      int worst = 0;
+      for (int i = 1; i < island->nb_trees; i++) {
+        if (tree_better(trees[worst], trees[i])) {
+          worst = i;
+        }
+      }
+      tree_delete(trees[worst]);
+      trees[worst] = t;
+      island->nb_received++;
+    }
+  }
+}
+
+typedef struct islands_job_t {
+  islands_t *islands;
+  int nb_generations;
+  int vary_first; /* Breed from the trees evaluated by the last epoch */
+} islands_job_t;
+
+/* Evolve island `task` for `nb_generations` generations, its trees are
+ * evaluated on return */
+static void island_evolve_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  const islands_job_t *job = (const islands_job_t *) arg;
+  const islands_t *islands = job->islands;
+  island_t *island = &islands->islands[task];
+  eval_ctx_t *ctx = eval_ctx_default();
+
+  for (int g = 0; g < job->nb_generations; g++) {
+    /* Next generation, the first trees of a run are scored exactly */
+    double max_score = INFINITY;
+    if (g > 0 || job->vary_first) {
+      island->trees = population_vary(&island->rng, island->trees, island->nb_trees,
+                                      islands->fs, islands->ts, islands->t_size,
+                                      islands->crossover_rate, islands->mutation_rate);
+      max_score = island->max_score;
+    }
+
+    /* Evaluate, offspring that cannot beat the bound of their parents are
+     * cut short */
+    population_evaluate_ctx(ctx, island->trees, island->nb_trees, islands->ds, max_score);
+    island->max_score = selection_bound(island->trees, island->nb_trees);
+    island->generation++;
+  }
+}
+
+/* Exact scores of the trees of island `task` */
+static void island_evaluate_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  const islands_t *islands = (const islands_t *) arg;
+  island_t *island = &islands->islands[task];
+  population_evaluate_ctx(eval_ctx_default(), island->trees, island->nb_trees,
+                          islands->ds, INFINITY);
+}
+
+/**
+ * Evolve every island for `nb_generations` generations on `pool`. Islands
+ * run in epochs up to the next migration point, one island per task, and
+ * threadpool_run() returning is the barrier between an epoch and the
+ * migration that follows it. Results only depend on the seed of
+ * islands_new(), not on the number of threads.
+ */
+int islands_run(islands_t *islands, threadpool_t *pool, const int nb_generations) {
+  islands_job_t job;
+  job.islands = islands;
+
+  for (int g = 0; g < nb_generations; g += job.nb_generations) {
+    /* All islands are at the same generation */
+    const int generation = islands->islands[0].generation;
+    const int interval = islands->migration_interval;
+    job.nb_generations = nb_generations - g;
+    if (interval > 0) {
+      job.nb_generations = MIN(job.nb_generations, interval - generation % interval);
+    }
+    job.vary_first = (g > 0);
+    threadpool_run(pool, island_evolve_task, &job, islands->nb_islands);
+
+    /* Migrate, every island sends before any receives */
+    if (interval > 0 && (generation + job.nb_generations) % interval == 0) {
+      threadpool_run(pool, island_send_task, islands, islands->nb_islands);
+      threadpool_run(pool, island_receive_task, islands, islands->nb_islands);
+    }
+  }
+
+  /* Exact scores of the last generation */
+  threadpool_run(pool, island_evaluate_task, islands, islands->nb_islands);
+  return 0;
+}
+
+/* Best tree of all islands */
+tree_t *islands_best(const islands_t *islands) {
+  tree_t *best = NULL;
+  for (int i = 0; i < islands->nb_islands; i++) {
+    const island_t *island = &islands->islands[i];
+    tree_t *t = best_tree(island->trees, island->nb_trees);
+    if (best == NULL || tree_better(t, best)) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+void islands_print(const islands_t *islands) {
+  for (int i = 0; i < islands->nb_islands; i++) {
+    const island_t *island = &islands->islands[i];
+    const tree_t *best = best_tree(island->trees, island->nb_trees);
+    printf("island[%d]: generation=%d best=%f sent=%ld received=%ld dropped=%ld\n",
+           i, island->generation, best->score,
+           island->nb_sent, island->nb_received, island->nb_dropped);
+  }
+}
+
+/******************************************************************************
+ *                               STEADY STATE
+ ******************************************************************************/
+
+/**
+ * Steady-state asynchronous GP on a shared population. Every worker loops
+ * on its own: it picks parents by tournament, breeds one offspring, evaluates
+ * it and replaces the loser of an inverse tournament if the offspring beats
+ * it. There are no generations, so a worker never waits for the others to
+ * finish their trees, whatever the cost of each.
+ *
+ * Each population slot has its own lock, held to read a score, copy a parent
+ * or swap in an offspring. Evaluation runs without locks, bounded by the
+ * loser's score, so an offspring that cannot replace it is cut short.
+ *
+ * A worker breeds into two scratch trees of its own, assigned from the
+ * parents (see tree_assign()). An offspring that replaces a tree swaps
+ * places with it, the replaced tree becoming the worker's scratch. Both
+ * scratch trees usually hold their node arrays and programs alone, so
+ * breeding and evaluating an offspring reuses them and only allocates when
+ * an offspring outgrows them.
+ */
+typedef struct steady_state_t {
+  tree_t **trees; /* Not owned, updated in place */
+  int nb_trees;
+  pthread_mutex_t *locks;
+
+  const function_set_t *fs;
+  const terminal_set_t *ts;
+  const dataset_t *ds;
+
+  /* Settings, defaults set by steady_state_new() */
+  int t_size;
+  double crossover_rate;
+  double mutation_rate;
+
+  /* Scratch offspring, two per worker, owned unless from a population */
+  tree_t **spares;
+  int nb_spares;
+  population_t *pop;
+
+  /* Current run */
+  rng_t *rngs; /* One per worker */
+  long max_evaluations;
+  double deadline;
+
+  /* Statistics */
+  atomic_long nb_evaluations;
+  atomic_long nb_replacements;
+  double elapsed;
+} steady_state_t;
+
+/**
+ * Steady-state GP on population `trees`, which is evaluated here and then
+ * updated in place by steady_state_run().
+ */
+steady_state_t *steady_state_new(tree_t **trees,
+                                 const int nb_trees,
+                                 const function_set_t *fs,
+                                 const terminal_set_t *ts,
+                                 const dataset_t *ds) {
+  steady_state_t *ss = (steady_state_t *) malloc(sizeof(steady_state_t));
+  ss->trees = trees;
+  ss->nb_trees = nb_trees;
+  ss->locks = (pthread_mutex_t *) malloc(sizeof(pthread_mutex_t) * nb_trees);
+  for (int i = 0; i < nb_trees; i++) {
+    pthread_mutex_init(&ss->locks[i], NULL);
+  }
+
+  ss->fs = fs;
+  ss->ts = ts;
+  ss->ds = ds;
+  ss->t_size = MAX(2, (int) (nb_trees * 0.01));
+  ss->crossover_rate = 0.0;
+  ss->mutation_rate = 1.0;
+
+  ss->spares = NULL;
+  ss->nb_spares = 0;
+  ss->pop = NULL;
+
+  ss->rngs = NULL;
+  ss->max_evaluations = 0;
+  ss->deadline = 0.0;
+  atomic_init(&ss->nb_evaluations, 0);
+  atomic_init(&ss->nb_replacements, 0);
+  ss->elapsed = 0.0;
+
+  population_evaluate(trees, nb_trees, ds);
+
+  return ss;
+}
+
+/**
+ * Steady-state GP on the current generation of population `pop`, which is
+ * evaluated here. The back generation of `pop` holds the scratch offspring,
+ * so a run needs two of its trees per thread, and trees only ever move
+ * between the two generations of `pop`. `pop` must not be bred while the
+ * steady state exists.
+ */
+steady_state_t *steady_state_new_population(population_t *pop,
+                                            const function_set_t *fs,
+                                            const terminal_set_t *ts,
+                                            const dataset_t *ds) {
+  steady_state_t *ss = steady_state_new(pop->trees, pop->nb_trees, fs, ts, ds);
+  ss->spares = pop->next;
+  ss->nb_spares = pop->nb_trees;
+  ss->pop = pop;
+  return ss;
+}
+
+void steady_state_delete(steady_state_t *ss) {
+  for (int i = 0; i < ss->nb_trees; i++) {
+    pthread_mutex_destroy(&ss->locks[i]);
+  }
+  if (ss->pop == NULL) {
+    for (int i = 0; i < ss->nb_spares; i++) {
+      tree_delete(ss->spares[i]);
+    }
+    free(ss->spares);
+  }
+  free(ss->locks);
+  free(ss);
+}
+
+/**
+ * Index of the winner of a tournament of `t_size + 1` random slots, or of the
+ * loser if `inverse`. `snapshot` is set to the score of the chosen slot when
+ * it was read, the slot may be replaced since.
+ */
+static int steady_state_tournament(steady_state_t *ss,
+                                   rng_t *rng,
+                                   const int inverse,
+                                   tree_t *snapshot) {
+  int chosen = -1;
+  for (int j = 0; j <= ss->t_size; j++) {
+    const int idx = randi(rng, 0, ss->nb_trees - 1);
+    pthread_mutex_lock(&ss->locks[idx]);
+    const tree_t *t = ss->trees[idx];
+    if (chosen == -1 || ((inverse) ? tree_better(snapshot, t) : tree_better(t, snapshot))) {
+      chosen = idx;
+      snapshot->score = t->score;
+      snapshot->dominated = t->dominated;
+    }
+    pthread_mutex_unlock(&ss->locks[idx]);
+  }
+  return chosen;
+}
+
+static void steady_state_assign(steady_state_t *ss, tree_t *t, const int idx) {
+  pthread_mutex_lock(&ss->locks[idx]);
+  tree_assign(t, ss->trees[idx]);
+  pthread_mutex_unlock(&ss->locks[idx]);
+}
+
+static void steady_state_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  steady_state_t *ss = (steady_state_t *) arg;
+  rng_t *rng = &ss->rngs[task];
+  tree_t **spares = &ss->spares[task * 2];
+  eval_ctx_t *ctx = eval_ctx_default();
+  tree_t snapshot;
+
+  while (1) {
+    /* Budget */
+    if (ss->deadline > 0.0 && threadpool_time() >= ss->deadline) {
+      break;
+    }
+    const long evaluation = atomic_fetch_add(&ss->nb_evaluations, 1);
+    if (ss->max_evaluations > 0 && evaluation >= ss->max_evaluations) {
+      break;
+    }
+
+    /* Breed */
+    tree_t *child = spares[0];
+    steady_state_assign(ss, child, steady_state_tournament(ss, rng, 0, &snapshot));
+    if (randf(rng, 0.0, 1.0) < ss->crossover_rate) {
+      steady_state_assign(ss, spares[1], steady_state_tournament(ss, rng, 0, &snapshot));
+      point_crossover(rng, child, spares[1]);
+    }
+    if (randf(rng, 0.0, 1.0) < ss->mutation_rate) {
+      subtree_mutation(rng, ss->fs, ss->ts, child);
+    }
+
+    /* Evaluate against the loser, replace it if still beaten */
+    const int loser = steady_state_tournament(ss, rng, 1, &snapshot);
+    const double max_score = (snapshot.dominated) ? INFINITY : snapshot.score;
+    evaluate_tree_ctx(ctx, child, ss->ds, max_score);
+
+    pthread_mutex_lock(&ss->locks[loser]);
+    if (tree_better(child, ss->trees[loser])) {
+      spares[0] = ss->trees[loser];
+      ss->trees[loser] = child;
+      atomic_fetch_add(&ss->nb_replacements, 1);
+    }
+    pthread_mutex_unlock(&ss->locks[loser]);
+  }
+}
+
+/**
+ * Run steady-state GP with one worker per thread of `pool`, each drawing from
+ * its own stream split from `rng`, until `max_evaluations` offspring are
+ * evaluated or `max_seconds` elapsed, a limit <= 0 is no limit. Runs are not
+ * reproducible since workers interleave.
+ */
+int steady_state_run(steady_state_t *ss,
+                     threadpool_t *pool,
+                     rng_t *rng,
+                     const long max_evaluations,
+                     const double max_seconds) {
+  assert(max_evaluations > 0 || max_seconds > 0.0);
+  const double start = threadpool_time();
+
+  /* Scratch offspring, a population has no trees to add */
+  if (ss->nb_spares < pool->nb_threads * 2) {
+    if (ss->pop) {
+      FATAL("Opps! Population of %d trees is too small for %d threads!",
+            ss->pop->nb_trees, pool->nb_threads);
+    }
+    ss->spares = (tree_t **) realloc(ss->spares, sizeof(tree_t *) * pool->nb_threads * 2);
+    for (int i = ss->nb_spares; i < pool->nb_threads * 2; i++) {
+      ss->spares[i] = tree_new();
+    }
+    ss->nb_spares = pool->nb_threads * 2;
+  }
+
+  ss->rngs = (rng_t *) malloc(sizeof(rng_t) * pool->nb_threads);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    ss->rngs[i] = rng_split(rng);
+  }
+  ss->max_evaluations = 0;
+  if (max_evaluations > 0) {
+    ss->max_evaluations = atomic_load(&ss->nb_evaluations) + max_evaluations;
+  }
+  ss->deadline = (max_seconds > 0.0) ? start + max_seconds : 0.0;
+
+  threadpool_run(pool, steady_state_task, ss, pool->nb_threads);
+
+  /* Evaluations past the budget were counted but not run */
+  if (ss->max_evaluations > 0 && atomic_load(&ss->nb_evaluations) > ss->max_evaluations) {
+    atomic_store(&ss->nb_evaluations, ss->max_evaluations);
+  }
+  free(ss->rngs);
+  ss->rngs = NULL;
+  ss->elapsed += threadpool_time() - start;
+
+  return 0;
+}
+
+void steady_state_print(const steady_state_t *ss) {
+  const tree_t *best = best_tree(ss->trees, ss->nb_trees);
+  printf("steady_state.evaluations: %ld\n", atomic_load(&ss->nb_evaluations));
+  printf("steady_state.replacements: %ld\n", atomic_load(&ss->nb_replacements));
+  printf("steady_state.elapsed: %f\n", ss->elapsed);
+  printf("steady_state.best: %f\n", best->score);
+}
+
+/******************************************************************************
+ *                             WORKER PROCESSES
+ ******************************************************************************/
+
+/* Maximum length of a field name in a shared dataset */
+#define SHM_FIELD_LEN 64
+
+/**
+ * Layout of a dataset in shared memory: this header, `nb_cols` field names
+ * of SHM_FIELD_LEN bytes, then the columns one after the other from
+ * `data_offset`, which is aligned to a cache line.
+ */
+typedef struct shm_header_t {
+  int nb_rows;
+  int nb_cols;
+  char predict[SHM_FIELD_LEN];
+  size_t data_offset;
+} shm_header_t;
+
+/* Write all of `buf` to file `fd`, returns -1 on error */
+static int io_write(const int fd, const void *buf, size_t size) {
+  const char *p = (const char *) buf;
+  while (size > 0) {
+    const ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/* Send all of `buf` on socket `fd`, returns -1 if the peer is gone */
+static int io_send(const int fd, const void *buf, size_t size) {
+  const char *p = (const char *) buf;
+  while (size > 0) {
+    const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/* Read exactly `size` bytes from `fd`, returns -1 on error or end of file */
+static int io_read(const int fd, void *buf, size_t size) {
+  char *p = (char *) buf;
+  while (size > 0) {
+    const ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/**
+ * Copy the columns of dataset `ds` to a new POSIX shared memory object
+ * `name`, e.g. "/sr-data", for other processes to attach to with
+ * dataset_shm_attach(). Returns -1 on error.
+ */
+int dataset_shm_create(const dataset_t *ds, const char *name) {
+  shm_header_t header;
+  memset(&header, 0, sizeof(shm_header_t));
+  header.nb_rows = ds->nb_rows;
+  header.nb_cols = ds->nb_cols;
+  if (strlen(ds->predict) >= SHM_FIELD_LEN) {
+    return -1;
+  }
+  strcpy(header.predict, ds->predict);
+  const size_t fields_size = (size_t) ds->nb_cols * SHM_FIELD_LEN;
+  header.data_offset = (sizeof(shm_header_t) + fields_size + 63) / 64 * 64;
+
+  /* Header and field names */
+  char *head = (char *) calloc(header.data_offset, 1);
+  memcpy(head, &header, sizeof(shm_header_t));
+  for (int i = 0; i < ds->nb_cols; i++) {
+    if (strlen(ds->fields[i]) >= SHM_FIELD_LEN) {
+      free(head);
+      return -1;
+    }
+    strcpy(head + sizeof(shm_header_t) + i * SHM_FIELD_LEN, ds->fields[i]);
+  }
+
+  /* Writing sizes the object, no ftruncate() needed */
+  const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    free(head);
+    return -1;
+  }
+  int retval = io_write(fd, head, header.data_offset);
+  for (int i = 0; i < ds->nb_cols && retval == 0; i++) {
+    retval = io_write(fd, ds->data[i], sizeof(double) * ds->nb_rows);
+  }
+  close(fd);
+  free(head);
+  if (retval != 0) {
+    shm_unlink(name);
+  }
+
+  return retval;
+}
+
+/**
+ * Map the dataset in shared memory object `name` read only. Columns point
+ * into the mapping, so every process attached shares one copy of the data.
+ * Returns NULL on error, free with dataset_delete().
+ */
+dataset_t *dataset_shm_attach(const char *name) {
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  shm_header_t header;
+  if (io_read(fd, &header, sizeof(shm_header_t)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  const size_t size = header.data_offset + sizeof(double) * header.nb_cols * header.nb_rows;
+  char *base = (char *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  dataset_t *ds = (dataset_t *) malloc(sizeof(dataset_t));
+  ds->nb_rows = header.nb_rows;
+  ds->nb_cols = header.nb_cols;
+  ds->data = (double **) malloc(sizeof(double *) * ds->nb_cols);
+  ds->fields = (char **) malloc(sizeof(char *) * ds->nb_cols);
+  for (int i = 0; i < ds->nb_cols; i++) {
+    ds->data[i] = (double *) (base + header.data_offset) + (size_t) i * ds->nb_rows;
+    ds->fields[i] = malloc_string(base + sizeof(shm_header_t) + i * SHM_FIELD_LEN);
+  }
+  ds->predict = malloc_string(header.predict);
+  ds->inputs = NULL;
+  dataset_bind(ds);
+  ds->shm = base;
+  ds->shm_size = size;
+
+  return ds;
+}
+
+void dataset_shm_unlink(const char *name) {
+  shm_unlink(name);
+}
+
+/**
+ * Local worker processes evaluating trees on a dataset they share through
+ * POSIX shared memory. Each worker is forked with one end of a UNIX domain
+ * socket, receives batches of compiled programs and sends back their errors
+ * and scores. Workers check the opcodes, arguments and stack of every
+ * program before evaluating it. A worker that dies, e.g. on a corrupt
+ * program, only fails its batch: its trees are marked dominated, so they
+ * lose to every fully evaluated tree, and the worker is forked again.
+ *
+ * Workers inherit the input ids of the coordinator, create the pool before
+ * starting threads since only the forking thread survives in the child.
+ */
+typedef struct procpool_t {
+  int nb_workers;
+  pid_t *pids;
+  int *sockets; /* Coordinator end of each worker's socket */
+  char shm_name[64];
+  long nb_restarts;
+} procpool_t;
+
+/* Most trees a worker accepts in one batch */
+#define PROCPOOL_MAX_BATCH (1 << 24)
+
+/* Batch header, followed by a program per tree */
+typedef struct procpool_batch_t {
+  int nb_trees;
+  double max_score;
+} procpool_batch_t;
+
+/* Program header, followed by `size` instructions and `nb_consts` constants */
+typedef struct procpool_program_t {
+  int size;
+  int depth;
+  int nb_consts;
+  int tree_size;
+} procpool_program_t;
+
+typedef struct procpool_result_t {
+  double error;
+  double score;
+  int dominated;
+} procpool_result_t;
+
+/* Receive a program, NULL if the batch is cut short or the program invalid */
+static tree_t *procpool_recv_tree(const int sock, const dataset_t *ds) {
+  procpool_program_t header;
+  if (io_read(sock, &header, sizeof(procpool_program_t)) != 0) {
+    return NULL;
+  }
+  if (header.size < 1 || header.size > MAX_TREE_SIZE ||
+      header.depth < 1 || header.depth > header.size ||
+      header.nb_consts < 0 || header.nb_consts > header.size) {
+    return NULL;
+  }
+
+  program_t *p = program_new(header.size);
+  p->size = header.size;
+  p->depth = header.depth;
+  p->nb_consts = header.nb_consts;
+  int valid = (io_read(sock, p->code, sizeof(instr_t) * p->size) == 0 &&
+               io_read(sock, p->consts, sizeof(double) * p->nb_consts) == 0);
+
+  /* Simulate the stack, evaluation sizes its buffers with the depth */
+  int height = 0;
+  int max_height = 0;
+  for (int k = 0; k < p->size && valid; k++) {
+    const instr_t *instr = &p->code[k];
+    if (instr->op == OP_INPUT) {
+      valid = (instr->arg >= 0 && instr->arg < ds->nb_inputs && ds->inputs[instr->arg] != -1);
+      height++;
+    } else if (instr->op == OP_CONST) {
+      valid = (instr->arg >= 0 && instr->arg < p->nb_consts);
+      height++;
+    } else if (instr->op >= ADD && instr->op <= COS) {
+      const int arity = (instr->op <= POW) ? 2 : 1;
+      valid = (height >= arity);
+      height -= arity - 1;
+    } else {
+      valid = 0;
+    }
+    max_height = MAX(max_height, height);
+  }
+  valid = valid && height == 1 && max_height == p->depth;
+  if (valid == 0) {
+    program_delete(p);
+    return NULL;
+  }
+
+  tree_t *t = tree_new();
+  t->program = p;
+  t->size = header.tree_size;
+  return t;
+}
+
+static void procpool_worker(const char *shm_name, const int sock) {
+  dataset_t *ds = dataset_shm_attach(shm_name);
+  if (ds == NULL || ds->target == NULL) {
+    _exit(1);
+  }
+  eval_ctx_t *ctx = eval_ctx_default();
+
+  procpool_batch_t batch;
+  while (io_read(sock, &batch, sizeof(procpool_batch_t)) == 0) {
+    if (batch.nb_trees <= 0 || batch.nb_trees > PROCPOOL_MAX_BATCH) {
+      _exit(2);
+    }
+    tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * batch.nb_trees);
+    for (int i = 0; i < batch.nb_trees; i++) {
+      trees[i] = procpool_recv_tree(sock, ds);
+      if (trees[i] == NULL) {
+        _exit(2);
+      }
+    }
+
+    population_evaluate_ctx(ctx, trees, batch.nb_trees, ds, batch.max_score);
+
+    procpool_result_t *results = (procpool_result_t *) calloc(batch.nb_trees, sizeof(procpool_result_t));
+    for (int i = 0; i < batch.nb_trees; i++) {
+      results[i].error = trees[i]->error;
+      results[i].score = trees[i]->score;
+      results[i].dominated = trees[i]->dominated;
+      tree_delete(trees[i]);
+    }
+    const int retval = io_send(sock, results, sizeof(procpool_result_t) * batch.nb_trees);
+    free(results);
+    free(trees);
+    if (retval != 0) {
+      break;
+    }
+  }
+
+  dataset_delete(ds);
+  close(sock);
+  _exit(0);
+}
+
+/* Fork worker `i` */
+static void procpool_spawn(procpool_t *pool, const int i) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    FATAL("Failed to create worker socket!");
+  }
+
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    FATAL("Failed to fork worker process!");
+  } else if (pid == 0) {
+    /* Only keep this worker's end, other workers' ends would hide EOF */
+    close(sv[0]);
+    for (int j = 0; j < pool->nb_workers; j++) {
+      if (pool->sockets[j] >= 0) {
+        close(pool->sockets[j]);
+      }
+    }
+    procpool_worker(pool->shm_name, sv[1]);
+  }
+
+  close(sv[1]);
+  pool->pids[i] = pid;
+  pool->sockets[i] = sv[0];
+}
+
+/* Stop worker `i`, closing its socket ends its loop */
+static void procpool_stop(procpool_t *pool, const int i) {
+  close(pool->sockets[i]);
+  pool->sockets[i] = -1;
+  waitpid(pool->pids[i], NULL, 0);
+}
+
+/**
+ * Copy dataset `ds` to shared memory and fork `nb_workers` worker processes,
+ * one per online CPU if `nb_workers` <= 0.
+ */
+procpool_t *procpool_new(const dataset_t *ds, int nb_workers) {
+  static int nb_pools = 0;
+  if (nb_workers <= 0) {
+    nb_workers = MAX(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+  }
+
+  procpool_t *pool = (procpool_t *) malloc(sizeof(procpool_t));
+  pool->nb_workers = nb_workers;
+  pool->pids = (pid_t *) malloc(sizeof(pid_t) * nb_workers);
+  pool->sockets = (int *) malloc(sizeof(int) * nb_workers);
+  for (int i = 0; i < nb_workers; i++) {
+    pool->sockets[i] = -1;
+  }
+  pool->nb_restarts = 0;
+
+  snprintf(pool->shm_name, 64, "/sr-%d-%d", (int) getpid(), nb_pools++);
+  if (dataset_shm_create(ds, pool->shm_name) != 0) {
+    FATAL("Failed to create shared dataset [%s]!", pool->shm_name);
+  }
+  for (int i = 0; i < nb_workers; i++) {
+    procpool_spawn(pool, i);
+  }
+
+  return pool;
+}
+
+void procpool_delete(procpool_t *pool) {
+  for (int i = 0; i < pool->nb_workers; i++) {
+    procpool_stop(pool, i);
+  }
+  dataset_shm_unlink(pool->shm_name);
+  free(pool->sockets);
+  free(pool->pids);
+  free(pool);
+}
+
+/* Serialize trees [`start`, `end`) into one batch message */
+static char *procpool_batch(tree_t **trees,
+                            const int start,
+                            const int end,
+                            const double max_score,
+                            size_t *size) {
+  *size = sizeof(procpool_batch_t);
+  for (int i = start; i < end; i++) {
+    const program_t *p = trees[i]->program;
+    *size += sizeof(procpool_program_t) + sizeof(instr_t) * p->size + sizeof(double) * p->nb_consts;
+  }
+
+  char *buf = (char *) calloc(*size, 1);
+  procpool_batch_t *batch = (procpool_batch_t *) buf;
+  batch->nb_trees = end - start;
+  batch->max_score = max_score;
+
+  char *pos = buf + sizeof(procpool_batch_t);
+  for (int i = start; i < end; i++) {
+    const program_t *p = trees[i]->program;
+    procpool_program_t header;
+    memset(&header, 0, sizeof(procpool_program_t));
+    header.size = p->size;
+    header.depth = p->depth;
+    header.nb_consts = p->nb_consts;
+    header.tree_size = trees[i]->size;
+    memcpy(pos, &header, sizeof(procpool_program_t));
+    pos += sizeof(procpool_program_t);
+    memcpy(pos, p->code, sizeof(instr_t) * p->size);
+    pos += sizeof(instr_t) * p->size;
+    memcpy(pos, p->consts, sizeof(double) * p->nb_consts);
+    pos += sizeof(double) * p->nb_consts;
+  }
+
+  return buf;
+}
+
+/**
+ * Evaluate `nb_trees` trees with the worker processes of `pool`, stopping
+ * early for trees that cannot score below `max_score`. Trees are compiled
+ * here and sent as one batch per worker, so a worker answers a whole batch
+ * at once and evaluates it tile by tile like population_evaluate_ctx().
+ */
+int population_evaluate_procs(procpool_t *pool,
+                              tree_t **trees,
+                              const int nb_trees,
+                              const double max_score) {
+  evaluate_compile(trees, nb_trees);
+
+  /* Send a batch to every worker */
+  int *failed = (int *) calloc(pool->nb_workers, sizeof(int));
+  for (int i = 0; i < pool->nb_workers; i++) {
+    const int start = (int) ((long) nb_trees * i / pool->nb_workers);
+    const int end = (int) ((long) nb_trees * (i + 1) / pool->nb_workers);
+    if (start == end) {
+      continue;
+    }
+    size_t size = 0;
+    char *buf = procpool_batch(trees, start, end, max_score, &size);
+    failed[i] = io_send(pool->sockets[i], buf, size);
+    free(buf);
+  }
+
+  /* Receive results */
+  for (int i = 0; i < pool->nb_workers; i++) {
+    const int start = (int) ((long) nb_trees * i / pool->nb_workers);
+    const int end = (int) ((long) nb_trees * (i + 1) / pool->nb_workers);
+    if (start == end) {
+      continue;
+    }
+    procpool_result_t *results = (procpool_result_t *) malloc(sizeof(procpool_result_t) * (end - start));
+    if (failed[i] == 0) {
+      failed[i] = io_read(pool->sockets[i], results, sizeof(procpool_result_t) * (end - start));
+    }
+
+    for (int k = start; k < end; k++) {
+      tree_t *t = trees[k];
+      t->error = (failed[i]) ? INFINITY : results[k - start].error;
+      t->score = (failed[i]) ? INFINITY : results[k - start].score;
+      t->dominated = (failed[i]) ? 1 : results[k - start].dominated;
+    }
+    free(results);
+
+    /* Replace a dead worker */
+    if (failed[i]) {
+      procpool_stop(pool, i);
+      procpool_spawn(pool, i);
+      pool->nb_restarts++;
+    }
+  }
+  free(failed);
+
+  return 0;
 }
 
 #endif
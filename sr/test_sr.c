@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <string.h>
 
 #include "sr/munit.h"
@@ -5,6 +6,9 @@
 
 #define CSV_TEST_DATA "./sr/test_data.csv"
 
+/* Random number generator of the tests, seeded in test_suite() */
+static rng_t rng;
+
 /******************************************************************************
  *                                 COMMON
  ******************************************************************************/
@@ -12,10 +16,18 @@
 int test_randi() {
   FILE *fp = fopen("/tmp/randi.csv", "w");
 
+  /* Bounds are inclusive */
+  int counts[3] = {0};
   for (int i = 0; i < 10000; i++) {
-    fprintf(fp, "%d\n", randi(0, 2));
+    const int x = randi(&rng, 0, 2);
+    MU_CHECK(x >= 0 && x <= 2);
+    counts[x]++;
+    fprintf(fp, "%d\n", x);
   }
   fclose(fp);
+  MU_CHECK(counts[0] > 3000 && counts[1] > 3000 && counts[2] > 3000);
+  MU_CHECK(randi(&rng, 5, 5) == 5);
+  MU_CHECK(randi(&rng, -3, -2) <= -2);
 
   return 0;
 }
@@ -24,13 +36,53 @@ int test_randf() {
   FILE *fp = fopen("/tmp/randf.csv", "w");
 
   for (int i = 0; i < 10000; i++) {
-    fprintf(fp, "%f\n", randf(0.0, 1.0));
+    const double x = randf(&rng, 0.0, 1.0);
+    MU_CHECK(x >= 0.0 && x < 1.0);
+    fprintf(fp, "%f\n", x);
   }
   fclose(fp);
 
   return 0;
 }
 
+int test_randf_bulk() {
+  /* Bulk draws are the same as one at a time */
+  rng_t r1, r2;
+  rng_seed(&r1, 42);
+  rng_seed(&r2, 42);
+
+  double x[100];
+  int y[100];
+  randf_bulk(&r1, x, 100, -2.0, 3.0);
+  randi_bulk(&r1, y, 100, 1, 6);
+  for (int i = 0; i < 100; i++) {
+    MU_CHECK(x[i] == randf(&r2, -2.0, 3.0));
+  }
+  for (int i = 0; i < 100; i++) {
+    MU_CHECK(y[i] == randi(&r2, 1, 6));
+  }
+
+  return 0;
+}
+
+int test_rng_split() {
+  /* Same seed, same stream */
+  rng_t r1, r2;
+  rng_seed(&r1, 1);
+  rng_seed(&r2, 1);
+  for (int i = 0; i < 10; i++) {
+    MU_CHECK(rng_next(&r1) == rng_next(&r2));
+  }
+
+  /* A split stream starts where the parent was, the parent jumps ahead */
+  rng_t stream = rng_split(&r1);
+  MU_CHECK(rng_next(&stream) == rng_next(&r2));
+  rng_t stream2 = rng_split(&r1);
+  MU_CHECK(rng_next(&stream2) != rng_next(&stream));
+
+  return 0;
+}
+
 int test_fltcmp() {
   MU_CHECK(fltcmp(1.0, 1.0) == 0);
   MU_CHECK(fltcmp(1.0, 0.0) == 1);
@@ -47,12 +99,61 @@ int test_malloc_string() {
   return 0;
 }
 
+/******************************************************************************
+ *                                 MEMORY
+ ******************************************************************************/
+
+int test_mem_alloc() {
+  /* Small regions come from the heap */
+  double *small = (double *) mem_alloc(sizeof(double) * 3, "small");
+  MU_CHECK(((uintptr_t) small % MEM_ALIGN) == 0);
+  MU_CHECK(mem_backing(small) == MEM_HEAP);
+  small[2] = 1.0;
+  mem_free(small);
+
+  /* Large regions are recorded with their backing */
+  const size_t size = 3 * HUGE_PAGE_SIZE + 8;
+  char *large = (char *) mem_alloc(size, "large");
+  MU_CHECK(large != NULL);
+  MU_CHECK(((uintptr_t) large % MEM_ALIGN) == 0);
+  const int backing = mem_backing(large);
+  if (backing != MEM_HEAP) {
+    MU_CHECK(((uintptr_t) large % HUGE_PAGE_SIZE) == 0);
+  }
+  memset(large, 1, size);
+  mem_print();
+  mem_free(large);
+
+  /* Memory from malloc() */
+  mem_free(malloc(16));
+  mem_free(NULL);
+
+  return 0;
+}
+
+/******************************************************************************
+ *                                 INPUTS
+ ******************************************************************************/
+
+int test_input_id() {
+  const int x = input_id("x");
+  const int y = input_id("y");
+
+  MU_CHECK(x != y);
+  MU_CHECK(input_id("x") == x);
+  MU_CHECK(input_id("y") == y);
+  MU_CHECK(strcmp(input_name(x), "x") == 0);
+  MU_CHECK(strcmp(input_name(y), "y") == 0);
+
+  return 0;
+}
+
 /******************************************************************************
  *                                 STACK
  ******************************************************************************/
 
 int test_stack_setup() {
-  stack_t s;
+  sr_stack_t s;
   stack_setup(&s);
 
   for (int i = 0; i < MAX_TREE_SIZE; i++) {
@@ -64,7 +165,7 @@ int test_stack_setup() {
 }
 
 int test_stack_push() {
-  stack_t s;
+  sr_stack_t s;
   stack_setup(&s);
 
   int data[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
@@ -81,7 +182,7 @@ int test_stack_push() {
 }
 
 int test_stack_pop() {
-  stack_t s;
+  sr_stack_t s;
   stack_setup(&s);
 
   int data[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
@@ -170,6 +271,7 @@ void free_terminal_set(terminal_set_t *ts) {
  ******************************************************************************/
 
 int test_node_new_and_delete() {
+  MU_CHECK(sizeof(node_t) == 48);
   node_t *n = node_new();
 
   /* General */
@@ -237,10 +339,9 @@ int test_node_string() {
   /* -- INPUT NODE */
   n.type = TERM_NODE;
   n.data_type = INPUT;
-  n.input_name = malloc_string((char *) "x");
+  n.input = input_id("x");
   s = node_string(&n);
   MU_CHECK(strcmp(s, "x") == 0);
-  free(n.input_name);
   free(s);
   /* -- CONST NODE */
   n.type = TERM_NODE;
@@ -325,7 +426,7 @@ int test_node_new_input() {
 
   MU_CHECK(n->type == TERM_NODE);
   MU_CHECK(n->data_type == INPUT);
-  MU_CHECK(strcmp(n->input_name, "x") == 0);
+  MU_CHECK(strcmp(input_name(n->input), "x") == 0);
 	node_delete(n);
 
   return 0;
@@ -350,7 +451,7 @@ int test_random_func() {
 	FILE *fp = fopen("/tmp/random_func.csv", "w");
 	for (int i = 0; i < 100000; i++) {
     /* Generate random function node */
-    node_t *n = random_func(fs);
+    node_t *n = random_func(&rng, fs);
 
     /* Assert */
     /* node_print(n); */
@@ -374,7 +475,7 @@ int test_random_term() {
 	FILE *fp = fopen("/tmp/random_term.csv", "w");
 	for (int i = 0; i < 100000; i++) {
     /* Generate random terminal node */
-    node_t *n = random_term(ts);
+    node_t *n = random_term(&rng, ts);
 
     /* Assert */
     /* node_print(n); */
@@ -389,6 +490,80 @@ int test_random_term() {
   return 0;
 }
 
+/******************************************************************************
+ *                                 PROGRAM
+ ******************************************************************************/
+
+int test_program_compile() {
+  /* Setup: ADD(SUB(1, 2), MUL(x, 3)) */
+  node_t *add = node_new_func(ADD, 2);
+  node_t *sub = node_new_func(SUB, 2);
+  node_t *mul = node_new_func(MUL, 2);
+  add->children[0] = sub;
+  add->children[1] = mul;
+  sub->children[0] = node_new_const(1.0);
+  sub->children[1] = node_new_const(2.0);
+  mul->children[0] = node_new_input((char *) "x");
+  mul->children[1] = node_new_const(3.0);
+
+  /* Compile */
+  program_t *p = program_compile(add);
+  program_print(p);
+
+  /* Assert */
+  MU_CHECK(p->size == 7);
+  MU_CHECK(p->depth == 3);
+  MU_CHECK(p->nb_consts == 3);
+
+  const int ops[7] = {OP_CONST, OP_CONST, SUB, OP_INPUT, OP_CONST, MUL, ADD};
+  for (int i = 0; i < 7; i++) {
+    MU_CHECK(p->code[i].op == ops[i]);
+  }
+  MU_CHECK(fltcmp(p->consts[p->code[0].arg], 1.0) == 0);
+  MU_CHECK(fltcmp(p->consts[p->code[1].arg], 2.0) == 0);
+  MU_CHECK(fltcmp(p->consts[p->code[4].arg], 3.0) == 0);
+  MU_CHECK(p->code[3].arg == input_id("x"));
+
+  /* Subtrees */
+  const int len[7] = {1, 1, 3, 1, 1, 3, 7};
+  for (int i = 0; i < 7; i++) {
+    MU_CHECK(p->len[i] == len[i]);
+  }
+  MU_CHECK(p->hash[0] != p->hash[1]);
+  MU_CHECK(p->hash[2] != p->hash[5]);
+
+  /* Equal subtrees hash the same in another program */
+  program_t *p2 = program_compile(mul);
+  MU_CHECK(p2->hash[p2->size - 1] == p->hash[5]);
+
+  /* Clean up */
+  program_delete(p2);
+  program_delete(p);
+  node_delete(add);
+
+  return 0;
+}
+
+int test_program_copy() {
+  node_t *mul = node_new_func(MUL, 2);
+  mul->children[0] = node_new_input((char *) "x");
+  mul->children[1] = node_new_const(3.0);
+
+  program_t *src = program_compile(mul);
+  program_t *des = program_copy(src);
+  node_delete(mul);
+  program_delete(src);
+
+  MU_CHECK(des->size == 3);
+  MU_CHECK(des->depth == 2);
+  MU_CHECK(des->code[2].op == MUL);
+  MU_CHECK(strcmp(input_name(des->code[0].arg), "x") == 0);
+  MU_CHECK(fltcmp(des->consts[des->code[1].arg], 3.0) == 0);
+  program_delete(des);
+
+  return 0;
+}
+
 /******************************************************************************
  *                                   TREE
  ******************************************************************************/
@@ -413,7 +588,7 @@ int test_tree_copy() {
   terminal_set_t *ts = setup_terminal_set();
 
   /* Generate tree */
-  tree_t *t1 = tree_generate(FULL, fs, ts, 2);
+  tree_t *t1 = tree_generate(&rng, FULL, fs, ts, 2);
   tree_t *t2 = tree_copy(t1);
 
   tree_print(t1);
@@ -474,7 +649,7 @@ int test_tree_generate() {
   /* Generate tree */
   tree_t *trees[5] = {0};
   for (int i = 0; i < 5; i++) {
-    trees[i] = tree_generate(FULL, fs, ts, 2);
+    trees[i] = tree_generate(&rng, FULL, fs, ts, 2);
     MU_CHECK(trees[i] != NULL);
 
     char *t_str = tree_string(trees[i]);
@@ -490,6 +665,316 @@ int test_tree_generate() {
   return 0;
 }
 
+int test_tree_compile() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Generated trees carry their program */
+  tree_t *t = tree_generate(&rng, FULL, fs, ts, 2);
+  MU_CHECK(t->program != NULL);
+  MU_CHECK(t->program->size == t->size);
+
+  /* Copies carry the program too */
+  tree_t *t_copy = tree_copy(t);
+  MU_CHECK(t_copy->program != NULL);
+  MU_CHECK(t_copy->program->size == t->program->size);
+
+  /* Variation invalidates the program */
+  point_mutation(&rng, fs, ts, t);
+  MU_CHECK(t->program == NULL);
+  tree_compile(t);
+  MU_CHECK(t->program != NULL);
+  MU_CHECK(t->program->size == t->size);
+
+  /* Clean up */
+  tree_delete(t);
+  tree_delete(t_copy);
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+  return 0;
+}
+
+int test_tree_pack() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+  MU_CHECK(sizeof(cnode_t) == 16);
+
+  for (int i = 0; i < 50; i++) {
+    tree_t *t = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 5);
+    char *expected = tree_string(t);
+    tree_compile(t);
+    program_t *p = program_copy(t->program);
+
+    /* Packed trees print and compile the same */
+    tree_pack(t);
+    MU_CHECK(t->root == NULL && t->nodes != NULL);
+    char *str = tree_string(t);
+    MU_CHECK(strcmp(str, expected) == 0);
+    free(str);
+    tree_compile(t);
+    MU_CHECK(t->program->size == p->size && t->program->depth == p->depth);
+    MU_CHECK(memcmp(t->program->code, p->code, sizeof(instr_t) * p->size) == 0);
+    MU_CHECK(memcmp(t->program->hash, p->hash, sizeof(uint64_t) * p->size) == 0);
+    MU_CHECK(memcmp(t->program->len, p->len, sizeof(int) * p->size) == 0);
+    MU_CHECK(memcmp(t->program->consts, p->consts, sizeof(double) * p->nb_consts) == 0);
+
+    /* Copies stay packed */
+    tree_t *t_copy = tree_copy(t);
+    MU_CHECK(t_copy->root == NULL && t_copy->nodes != NULL);
+
+    /* Unpacking restores the nodes */
+    tree_unpack(t);
+    MU_CHECK(t->nodes == NULL);
+    MU_CHECK(subtree_size(t->root) == t->size);
+    str = tree_string(t);
+    MU_CHECK(strcmp(str, expected) == 0);
+    free(str);
+
+    /* Variation works on the packed nodes */
+    subtree_mutation(&rng, fs, ts, t_copy);
+    MU_CHECK(t_copy->nodes != NULL && tree_subtree_end(t_copy, 0) == t_copy->size);
+
+    /* Clean up */
+    free(expected);
+    program_delete(p);
+    tree_delete(t);
+    tree_delete(t_copy);
+  }
+
+  /* Trees generated packed are those tree_generate() packs */
+  for (int depth = 1; depth <= 4; depth++) {
+    for (int method = FULL; method <= GROW; method++) {
+      rng_t stream;
+      rng_t packed_stream;
+      rng_seed(&stream, depth);
+      rng_seed(&packed_stream, depth);
+      tree_t *t = tree_generate(&stream, method, fs, ts, depth);
+      cnode_t nodes[64];
+      const int nb_nodes = cnode_generate(&packed_stream, method, fs, ts, depth, nodes);
+      tree_pack(t);
+      MU_CHECK(nb_nodes == t->size);
+      MU_CHECK(nodes[0].height == t->depth);
+      MU_CHECK(memcmp(nodes, t->nodes, sizeof(cnode_t) * nb_nodes) == 0);
+      MU_CHECK(rng_next(&stream) == rng_next(&packed_stream));
+      tree_delete(t);
+    }
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+  return 0;
+}
+
+/* Check packed tree `t` against unpacked tree `expected` */
+static int check_packed(const tree_t *t, const tree_t *expected) {
+  char *s1 = tree_string(t);
+  char *s2 = tree_string(expected);
+  const int same = (strcmp(s1, s2) == 0);
+  free(s1);
+  free(s2);
+  MU_CHECK(same);
+  MU_CHECK(t->nodes != NULL);
+  MU_CHECK(t->size == expected->size);
+  MU_CHECK(t->depth == expected->depth);
+  MU_CHECK(tree_subtree_end(t, 0) == t->size);
+
+  /* Every height one more than its highest child's */
+  for (int i = 0; i < t->size; i++) {
+    int height = 0;
+    int child = i + 1;
+    for (int k = 0; k < t->nodes[i].arity; k++) {
+      height = MAX(height, t->nodes[child].height + 1);
+      child += t->nodes[child].len;
+    }
+    MU_CHECK(t->nodes[i].height == height);
+    MU_CHECK(child == tree_subtree_end(t, i));
+  }
+  return 0;
+}
+
+int test_tree_splice() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Operators give the same trees packed and unpacked */
+  for (int i = 0; i < 100; i++) {
+    tree_t *a = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 4);
+    tree_t *b = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 4);
+    tree_t *a_packed = tree_copy(a);
+    tree_t *b_packed = tree_copy(b);
+    tree_pack(a_packed);
+    tree_pack(b_packed);
+
+    rng_t stream;
+    rng_t packed_stream;
+    rng_seed(&stream, i);
+    rng_seed(&packed_stream, i);
+    point_crossover(&stream, a, b);
+    point_crossover(&packed_stream, a_packed, b_packed);
+    MU_CHECK(check_packed(a_packed, a) == 0);
+    MU_CHECK(check_packed(b_packed, b) == 0);
+
+    subtree_mutation(&stream, fs, ts, a);
+    subtree_mutation(&packed_stream, fs, ts, a_packed);
+    MU_CHECK(check_packed(a_packed, a) == 0);
+
+    point_mutation(&stream, fs, ts, b);
+    point_mutation(&packed_stream, fs, ts, b_packed);
+    MU_CHECK(check_packed(b_packed, b) == 0);
+    MU_CHECK(a_packed->program == NULL && b_packed->program == NULL);
+
+    /* Subtree extents */
+    const int idx = randi(&rng, 0, a_packed->size - 1);
+    tree_t *sub = tree_subtree(a_packed, idx);
+    MU_CHECK(sub->size == subtree_size(tree_get_node(a, idx)));
+    MU_CHECK(sub->depth == a_packed->nodes[idx].height);
+    MU_CHECK(tree_subtree_end(a_packed, idx) == idx + sub->size);
+
+    /* Splices past the size limit fail and leave the tree as it was */
+    const int size = a_packed->size;
+    MU_CHECK(tree_splice(a_packed, 0, a_packed->nodes, CNODE_MAX_SIZE + 1) == -1);
+    MU_CHECK(a_packed->size == size);
+    MU_CHECK(check_packed(a_packed, a) == 0);
+
+    /* Clean up */
+    tree_delete(sub);
+    tree_delete(a);
+    tree_delete(b);
+    tree_delete(a_packed);
+    tree_delete(b_packed);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+  return 0;
+}
+
+int test_tree_own() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  for (int i = 0; i < 50; i++) {
+    tree_t *t = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 4);
+    tree_pack(t);
+    tree_compile(t);
+    char *expected = tree_string(t);
+
+    /* Copies share the nodes and the program */
+    tree_t *a = tree_copy(t);
+    tree_t *b = tree_copy(t);
+    MU_CHECK(a->nodes == t->nodes && b->nodes == t->nodes);
+    MU_CHECK(a->program == t->program);
+    MU_CHECK(atomic_load(&CNODE_HEADER(t->nodes)->refs) == 3);
+    MU_CHECK(atomic_load(&t->program->refs) == 3);
+
+    /* Variation copies the nodes first */
+    subtree_mutation(&rng, fs, ts, a);
+    point_mutation(&rng, fs, ts, b);
+    MU_CHECK(a->nodes != t->nodes && b->nodes != t->nodes);
+    MU_CHECK(atomic_load(&CNODE_HEADER(t->nodes)->refs) == 1);
+    MU_CHECK(atomic_load(&t->program->refs) == 1);
+    char *str = tree_string(t);
+    MU_CHECK(strcmp(str, expected) == 0);
+    free(str);
+
+    /* Unshared nodes are changed in place */
+    cnode_t *nodes = b->nodes;
+    point_mutation(&rng, fs, ts, b);
+    MU_CHECK(b->nodes == nodes);
+
+    /* Shared by both trees of a crossover, swapping keeps the nodes */
+    tree_t *c = tree_copy(t);
+    const int size = t->size;
+    point_crossover(&rng, t, c);
+    MU_CHECK(t->size + c->size == 2 * size);
+    MU_CHECK(tree_subtree_end(t, 0) == t->size);
+    MU_CHECK(tree_subtree_end(c, 0) == c->size);
+
+    /* Clean up */
+    free(expected);
+    tree_delete(t);
+    tree_delete(a);
+    tree_delete(b);
+    tree_delete(c);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+  return 0;
+}
+
+int test_tree_assign() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+  rng_t rng;
+  rng_seed(&rng, 7);
+
+  tree_t *big = tree_generate(&rng, FULL, fs, ts, 4);
+  tree_t *small = tree_generate(&rng, FULL, fs, ts, 2);
+  tree_pack(big);
+  tree_pack(small);
+
+  /* Assigning shares the nodes */
+  tree_t *t = tree_new();
+  tree_assign(t, big);
+  MU_CHECK(t->nodes == big->nodes);
+  MU_CHECK(t->size == big->size);
+  MU_CHECK(t->spare == NULL);
+
+  /* Owning copies into a new array, assigning keeps it as the spare */
+  tree_own(t);
+  cnode_t *owned = t->nodes;
+  MU_CHECK(owned != big->nodes);
+  tree_assign(t, small);
+  MU_CHECK(t->spare == owned);
+  MU_CHECK(t->nodes == small->nodes);
+
+  /* Owning reuses the spare when it is large enough */
+  tree_own(t);
+  MU_CHECK(t->nodes == owned);
+  MU_CHECK(t->spare == NULL);
+  char *str = tree_string(t);
+  char *expected = tree_string(small);
+  MU_CHECK(strcmp(str, expected) == 0);
+  free(str);
+  free(expected);
+
+  /* Unshared programs are compiled again in place, shared ones dropped */
+  tree_compile(t);
+  program_t *program = t->program;
+  tree_t *copy = tree_copy(t);
+  tree_invalidate(copy);
+  MU_CHECK(copy->spare_program == NULL && atomic_load(&program->refs) == 1);
+  tree_delete(copy);
+  tree_invalidate(t);
+  MU_CHECK(t->program == NULL && t->spare_program == program);
+  tree_compile(t);
+  MU_CHECK(t->program == program && t->spare_program == NULL);
+  MU_CHECK(t->program->size == t->size);
+
+  /* Assigning a linked tree copies its nodes */
+  tree_t *linked = tree_generate(&rng, FULL, fs, ts, 2);
+  tree_assign(t, linked);
+  MU_CHECK(t->root != NULL && t->root != linked->root);
+  MU_CHECK(t->nodes == NULL && t->spare == owned);
+
+  /* Clean up */
+  tree_delete(t);
+  tree_delete(linked);
+  tree_delete(big);
+  tree_delete(small);
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+  return 0;
+}
+
 int test_tree_update() {
   /* Setup */
   tree_t *t = tree_new();
@@ -639,7 +1124,7 @@ int test_tree_select_rand_func() {
 
   /* Assert */
   tree_update(t);
-  int idx = tree_select_rand_func(t);
+  int idx = tree_select_rand_func(&rng, t);
   /* printf("idx: %d\n", idx); */
   MU_CHECK(idx == 0 || idx == 1 || idx == 4 || idx == 6);
 	tree_delete(t);
@@ -681,7 +1166,7 @@ int test_tree_stack() {
   tree_update(t);
   /* tree_print(&t); */
 
-  stack_t s;
+  sr_stack_t s;
 	stack_setup(&s);
   tree_stack(t, &s);
   for (int i = 0; i < s.size; i++) {
@@ -749,12 +1234,12 @@ int test_point_mutation() {
 	int success = 0;
 	for (int i = 0; i < 100; i++) {
 		/* Generate tree */
-		tree_t *t = tree_generate(GROW, fs, ts, 2);
+		tree_t *t = tree_generate(&rng, GROW, fs, ts, 2);
 
 		char *t_before = tree_string(t);
 		/* printf("%s\n", t_str); */
 
-		point_mutation(fs, ts, t);
+		point_mutation(&rng, fs, ts, t);
 
 		char *t_after = tree_string(t);
 		/* printf("%s\n", t_str); */
@@ -782,26 +1267,29 @@ int test_subtree_mutation() {
   function_set_t *fs = setup_function_set();
   terminal_set_t *ts = setup_terminal_set();
 
-  /* Test subtree mutation */
+  /* Test subtree mutation, a mutation may regenerate the same subtree */
+  int nb_changed = 0;
   for (int i = 0; i < 100; i++) {
     /* Generate tree */
-    tree_t *t = tree_generate(GROW, fs, ts, 2);
+    tree_t *t = tree_generate(&rng, GROW, fs, ts, 2);
 
     char *t_before = tree_string(t);
     printf("BEFORE: %s\n", t_before);
 
-    subtree_mutation(fs, ts, t);
+    subtree_mutation(&rng, fs, ts, t);
 
     char *t_after = tree_string(t);
     printf("AFTER:  %s\n", t_after);
 
-    MU_CHECK(strcmp(t_before, t_after) != 0);
+    nb_changed += (strcmp(t_before, t_after) != 0);
+    MU_CHECK(subtree_size(t->root) == t->size);
 
     /* Clean up */
     free(t_before);
     free(t_after);
     tree_delete(t);
   }
+  MU_CHECK(nb_changed >= 50);
 
 	/* Clean up */
 	free_function_set(fs);
@@ -820,8 +1308,8 @@ int test_point_crossover() {
   terminal_set_t *ts = setup_terminal_set();
 
   /* Generate tree */
-  tree_t *t1 = tree_generate(FULL, fs, ts, 3);
-  tree_t *t2 = tree_generate(FULL, fs, ts, 3);
+  tree_t *t1 = tree_generate(&rng, FULL, fs, ts, 3);
+  tree_t *t2 = tree_generate(&rng, FULL, fs, ts, 3);
   char *t1_str = NULL;
   char *t2_str = NULL;
 
@@ -835,7 +1323,7 @@ int test_point_crossover() {
   free(t2_str);
 
   /* Point crossover */
-  point_crossover(t1, t2);
+  point_crossover(&rng, t1, t2);
 
   /* After */
   t1_str = tree_string(t1);
@@ -846,11 +1334,48 @@ int test_point_crossover() {
   free(t1_str);
   free(t2_str);
 
+  /* A node tree crossed with a packed tree keeps the outputs of the nodes off
+   * the swapped spine, ADD(MUL(SIN(x), x), COS(x)) always has one of them */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  for (int i = 0; i < 20; i++) {
+    tree_t *t = tree_new();
+    node_t *add = node_new_func(ADD, 2);
+    node_t *mul = node_new_func(MUL, 2);
+    node_t *sin_ = node_new_func(SIN, 1);
+    node_t *cos_ = node_new_func(COS, 1);
+    add->children[0] = mul;
+    add->children[1] = cos_;
+    mul->children[0] = sin_;
+    mul->children[1] = node_new_input("x");
+    sin_->children[0] = node_new_input("x");
+    cos_->children[0] = node_new_input("x");
+    t->root = add;
+    tree_update(t);
+    evaluate_tree_incremental(t, ds);
+
+    tree_t *packed = tree_generate(&rng, FULL, fs, ts, 3);
+    tree_pack(packed);
+    point_crossover(&rng, t, packed);
+    MU_CHECK(t->nodes == NULL);
+    MU_CHECK(add->output_valid == 0);
+    MU_CHECK(mul->output_valid || sin_->output_valid || cos_->output_valid);
+
+    /* Same error as evaluating the program */
+    evaluate_tree_incremental(t, ds);
+    const double error = t->error;
+    evaluate_tree(t, ds);
+    MU_CHECK(t->error == error || (isnan(t->error) && isnan(error)));
+
+    tree_delete(t);
+    tree_delete(packed);
+  }
+
   /* clean up */
   tree_delete(t1);
   tree_delete(t2);
 	free_function_set(fs);
 	free_terminal_set(ts);
+	dataset_delete(ds);
 
   return 0;
 }
@@ -867,14 +1392,14 @@ int test_tournament_selection() {
   /* Generate trees */
   tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * 10);
   for (int i = 0; i < 10; i++) {
-    trees[i] = tree_generate(FULL, fs, ts, 2);
+    trees[i] = tree_generate(&rng, FULL, fs, ts, 2);
     trees[i]->score = i;
     printf("score: %f\n", trees[i]->score);
   }
   printf("---\n");
 
   /* Perform selection */
-  trees = tournament_selection(trees, 10, 10000);
+  trees = tournament_selection(&rng, trees, 10, 10000);
   for (int i = 0; i < 10; i++) {
     printf("score: %f\n", trees[i]->score);
     MU_CHECK(fltcmp(trees[i]->score, 0.0) == 0);
@@ -972,6 +1497,26 @@ int test_dataset_load_and_delete() {
   return 0;
 }
 
+int test_dataset_bind() {
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+  /* Inputs are bound to columns and the target column is cached */
+  MU_CHECK(dataset_column(ds, input_id("x")) == 0);
+  MU_CHECK(dataset_column(ds, input_id("y")) == 1);
+  MU_CHECK(ds->target == ds->data[1]);
+  MU_CHECK(dataset_expected(ds) == ds->data[1]);
+
+  /* Inputs that are not in the dataset stay unbound */
+  const int z = input_id("z");
+  dataset_bind(ds);
+  MU_CHECK(ds->nb_inputs > z);
+  MU_CHECK(ds->inputs[z] == -1);
+
+	dataset_delete(ds);
+
+  return 0;
+}
+
 int test_evaluate_tree() {
   /* Load dataset */
 	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
@@ -1040,110 +1585,1733 @@ int test_evaluate_tree2() {
   return 0;
 }
 
-int test_best_tree() {
-  /* Setup trees */
-  tree_t **trees = (tree_t **) malloc(sizeof(tree_t) * 10);
-  for (int i = 0; i < 10; i++) {
-    trees[i] = tree_new();
-    trees[i]->score = i;
-  }
+int test_evaluate_tree_operand_order() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
 
-  /* Find best */
-  tree_t *best = best_tree(trees, 10);
-  MU_CHECK(fltcmp(best->score, 0.0) == 0);
+	/* Build a tree: SUB(x, -100) == x + 100 */
+  tree_t *t = tree_new();
+  node_t *sub = node_new_func(SUB, 2);
+  sub->children[0] = node_new_input((char *) "x");
+  sub->children[1] = node_new_const(-100.0);
+  t->root = sub;
+  tree_update(t);
 
-  /* Clean up */
-  for (int i = 0; i < 10; i++) {
-    tree_delete(trees[i]);
-  }
-  free(trees);
+  /* Evaluate */
+  evaluate_tree(t, ds);
+  MU_CHECK(fltcmp(t->error, 0.0) == 0);
+
+	/* Clean up */
+	tree_delete(t);
+	dataset_delete(ds);
 
   return 0;
 }
 
-int test_regress() {
-	/* Setup function and terminal set */
-  function_set_t *fs = setup_function_set();
-  terminal_set_t *ts = setup_terminal_set();
-
-  /* Load dataset and generate trees */
+int test_evaluate_tree_scalar_operands() {
+  /* Load dataset */
 	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
-	int nb_trees = 1000;
-	tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
-	for (int i = 0; i < nb_trees; i++) {
-    trees[i] = tree_generate(GROW, fs, ts, 3);
-	}
 
-	/* #<{(| Evaluate |)}># */
-	/* for (int i = 0; i < nb_trees; i++) { */
-	/* 	evaluate_tree(trees[i], ds); */
-	/* } */
-	/* printf("---------\n"); */
-	/* for (int i = 0; i < nb_trees; i++) { */
-	/* 	char *s = tree_string(trees[i]); */
-	/* 	printf("tree[%f]: %s\n", trees[i]->score, s); */
-	/* 	free(s); */
-	/* } */
-
-	/* tree_delete(trees[0]); */
-  /* tree_t *t = tree_new(); */
-  /* node_t *mul = node_new_func(MUL, 2); */
-  /* node_t *add = node_new_func(ADD, 2); */
-  /* node_t *hundred = node_new_const(100.0); */
-  /* node_t *x1 = node_new_input((char *) "x"); */
-  /* node_t *x2 = node_new_input((char *) "x"); */
-  /* t->root = add; */
-  /* add->children[0] = mul; */
-  /* add->children[1] = hundred; */
-  /* mul->children[0] = x1; */
-  /* mul->children[1] = x2; */
-  /* tree_update(t); */
-  /* trees[0] = t; */
+	/* SUB(100, SUB(0, x)) == x + 100: scalar-vector kernels */
+  tree_t *t = tree_new();
+  node_t *sub = node_new_func(SUB, 2);
+  node_t *neg = node_new_func(SUB, 2);
+  sub->children[0] = node_new_const(100.0);
+  sub->children[1] = neg;
+  neg->children[0] = node_new_const(0.0);
+  neg->children[1] = node_new_input("x");
+  t->root = sub;
+  tree_update(t);
+  evaluate_tree(t, ds);
+  MU_CHECK(fltcmp(t->error, 0.0) == 0);
+  tree_delete(t);
 
-  int max_iter = 2000;
-  int iter = 0;
-	while (iter != max_iter) {
-    /* Evaluate */
-	  for (int i = 0; i < nb_trees; i++) {
-      evaluate_tree(trees[i], ds);
-	  }
+	/* ADD(x, MUL(50, 2)) == x + 100: vector-scalar kernel and folding */
+  t = tree_new();
+  node_t *add = node_new_func(ADD, 2);
+  node_t *mul = node_new_func(MUL, 2);
+  add->children[0] = node_new_input("x");
+  add->children[1] = mul;
+  mul->children[0] = node_new_const(50.0);
+  mul->children[1] = node_new_const(2.0);
+  t->root = add;
+  tree_update(t);
+  evaluate_tree(t, ds);
+  MU_CHECK(fltcmp(t->error, 0.0) == 0);
+  tree_delete(t);
 
-	  /* Show the best */
-	  /* printf("---------\n"); */
-	  /* for (int i = 0; i < nb_trees; i++) { */
-    /*   char *s = tree_string(trees[i]); */
-    /*   printf("tree[%f]: %s\n", trees[i]->score, s); */
-    /*   free(s); */
-	  /* } */
-	  /* printf("---------\n"); */
-	  tree_t *best = best_tree(trees, nb_trees);
-	  char *t_str = tree_string(best);
-	  printf("iter[%d] score: %f\t error: %f [%s]\n", iter, best->score, best->error, t_str);
-	  free(t_str);
+	/* Clean up */
+	dataset_delete(ds);
 
-    /* Selection */
-    int t_size = nb_trees * 0.01;
-    trees = tournament_selection(trees, nb_trees, t_size);
+  return 0;
+}
 
-	  /* #<{(| Crossover |)}># */
-	  /* for (int i = 0; i < nb_trees; i+=2) { */
-	  /*   if (randf(0.0, 1.0) < 0.8) { */
-    /*     point_crossover(trees[i], trees[i + 1]); */
-    /*   } */
-    /* } */
+int test_eval_ctx_reserve() {
+  eval_ctx_t *ctx = eval_ctx_new();
+  MU_CHECK(ctx->nb_buffers == 0);
+
+  /* Grow */
+  eval_ctx_reserve(ctx, 3, 10);
+  MU_CHECK(ctx->nb_buffers == 3);
+  MU_CHECK(ctx->nb_rows == 10);
+  double *buffer = ctx->buffers[0];
+
+  /* Smaller requests reuse the buffers */
+  eval_ctx_reserve(ctx, 2, 5);
+  MU_CHECK(ctx->nb_buffers == 3);
+  MU_CHECK(ctx->nb_rows == 10);
+  MU_CHECK(ctx->buffers[0] == buffer);
+
+  /* More buffers keep the values of existing ones */
+  buffer[9] = 3.0;
+  eval_ctx_reserve(ctx, 5, 10);
+  MU_CHECK(ctx->nb_buffers == 5);
+  MU_CHECK(fltcmp(ctx->buffers[0][9], 3.0) == 0);
+  for (int i = 0; i < ctx->nb_buffers; i++) {
+    MU_CHECK(((uintptr_t) ctx->buffers[i] % MEM_ALIGN) == 0);
+  }
 
-    /* Mutate */
-	  for (int i = 0; i < nb_trees; i++) {
-	    if (randf(0.0, 1.0) < 0.2) {
-        /* point_mutation(fs, ts, trees[i]); */
-        subtree_mutation(fs, ts, trees[i]);
-      }
-    }
+  eval_ctx_delete(ctx);
+
+  return 0;
+}
+
+int test_evaluate_tree_nested() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+	/* ADD(MUL(x, x), ADD(x, 100)), both intermediates must stay live */
+  tree_t *t = tree_new();
+  node_t *add = node_new_func(ADD, 2);
+  node_t *mul = node_new_func(MUL, 2);
+  node_t *add2 = node_new_func(ADD, 2);
+  add->children[0] = mul;
+  add->children[1] = add2;
+  mul->children[0] = node_new_input("x");
+  mul->children[1] = node_new_input("x");
+  add2->children[0] = node_new_input("x");
+  add2->children[1] = node_new_const(100.0);
+  t->root = add;
+  tree_update(t);
+
+  /* Error is the RMSE of x^2 */
+  eval_ctx_t *ctx = eval_ctx_new();
+  evaluate_tree_ctx(ctx, t, ds, INFINITY);
+  MU_CHECK(ctx->nb_buffers == t->program->depth);
+
+  const double *x = ds->data[0];
+  double err_sq = 0.0;
+  for (int i = 0; i < ds->nb_rows; i++) {
+    err_sq += x[i] * x[i] * x[i] * x[i];
+  }
+  MU_CHECK(fltcmp(t->error, sqrt(err_sq / ds->nb_rows)) == 0);
+
+	/* Clean up */
+  eval_ctx_delete(ctx);
+	tree_delete(t);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+static double ulp_diff(const double a, const double b) {
+  if (isnan(a) || isnan(b)) {
+    return (isnan(a) && isnan(b)) ? 0.0 : INFINITY;
+  }
+  if (a == b) {
+    return 0.0;
+  }
+  return fabs(a - b) / (nextafter(fabs(b), INFINITY) - fabs(b));
+}
+
+static double kernel_max_ulp(const kernel_t *k,
+                             const double *x,
+                             const double *y,
+                             const int n,
+                             double (*ref)(double, double)) {
+  double z[1001];
+  double max_ulp = 0.0;
+  k->vv(x, y, z, n);
+  for (int i = 0; i < n; i++) {
+    const double expected = ref(x[i], (y) ? y[i] : 0.0);
+    const double ulp = ulp_diff(z[i], expected);
+    max_ulp = (ulp > max_ulp) ? ulp : max_ulp;
+  }
+  return max_ulp;
+}
+
+static double ref_exp(double x, double y) {
+  (void) y;
+  return exp(x);
+}
+
+static double ref_log(double x, double y) {
+  (void) y;
+  return log(x);
+}
+
+static double ref_sin(double x, double y) {
+  (void) y;
+  return sin(x);
+}
+
+static double ref_cos(double x, double y) {
+  (void) y;
+  return cos(x);
+}
+
+
+int test_evaluate_tree_tiled() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+	/* SUB(MUL(x, x), SIN(x)) */
+  tree_t *t = tree_new();
+  node_t *sub = node_new_func(SUB, 2);
+  node_t *mul = node_new_func(MUL, 2);
+  node_t *sin_ = node_new_func(SIN, 1);
+  sub->children[0] = mul;
+  sub->children[1] = sin_;
+  mul->children[0] = node_new_input("x");
+  mul->children[1] = node_new_input("x");
+  sin_->children[0] = node_new_input("x");
+  t->root = sub;
+  tree_update(t);
+
+  /* All rows at once */
+  eval_ctx_t *ctx = eval_ctx_new();
+  ctx->tile_rows = 0;
+  evaluate_tree_ctx(ctx, t, ds, INFINITY);
+  const double error = t->error;
+  MU_CHECK(ctx->nb_rows == ds->nb_rows);
+
+  /* Tiles of 4 rows, the last tile is partial */
+  eval_ctx_t *tiled = eval_ctx_new();
+  tiled->tile_rows = 4;
+  evaluate_tree_ctx(tiled, t, ds, INFINITY);
+  MU_CHECK(tiled->nb_rows == 4);
+  MU_CHECK(fltcmp(t->error, error) == 0);
+
+	/* Clean up */
+  eval_ctx_delete(tiled);
+  eval_ctx_delete(ctx);
+	tree_delete(t);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_evaluate_tree_bounded() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+  /* Predicting x is 100 off on every row */
+  tree_t *t = tree_new();
+  t->root = node_new_input("x");
+  tree_update(t);
+  evaluate_tree(t, ds);
+  MU_CHECK(t->dominated == 0);
+  MU_CHECK(fltcmp(t->error, 100.0) == 0);
+
+  /* A bound it cannot meet stops evaluation, the partial error is not kept */
+  eval_ctx_t *ctx = eval_ctx_new();
+  ctx->tile_rows = 2;
+  evaluate_tree_ctx(ctx, t, ds, 10.0);
+  MU_CHECK(t->dominated == 1);
+  MU_CHECK(t->error == INFINITY && t->score == INFINITY);
+
+  /* A bound below the size penalty needs no rows at all */
+  evaluate_tree_ctx(ctx, t, ds, 0.05);
+  MU_CHECK(t->dominated == 1);
+  MU_CHECK(t->error == INFINITY && t->score == INFINITY);
+
+  /* A bound it meets evaluates every row */
+  evaluate_tree_ctx(ctx, t, ds, 101.0);
+  MU_CHECK(t->dominated == 0);
+  MU_CHECK(fltcmp(t->error, 100.0) == 0);
+
+  /* Fully evaluated trees beat dominated ones */
+  tree_t *t2 = tree_copy(t);
+  t2->score = 1000.0;
+  t->dominated = 1;
+  MU_CHECK(tree_better(t2, t) == 1);
+  MU_CHECK(tree_better(t, t2) == 0);
+
+	/* Clean up */
+  eval_ctx_delete(ctx);
+	tree_delete(t2);
+	tree_delete(t);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_population_evaluate() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Load dataset and generate trees */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+	const int nb_trees = 50;
+	tree_t *trees[50];
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+
+  /* Same errors as evaluating tree by tree, in tiles of 4 rows */
+  eval_ctx_t *ctx = eval_ctx_new();
+  ctx->tile_rows = 4;
+  double errors[50];
+	for (int i = 0; i < nb_trees; i++) {
+    evaluate_tree_ctx(ctx, trees[i], ds, INFINITY);
+    errors[i] = trees[i]->error;
+	}
+  population_evaluate_ctx(ctx, trees, nb_trees, ds, INFINITY);
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(trees[i]->dominated == 0);
+    MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+	}
+
+  /* Bounded by the best score, only trees as good are fully evaluated */
+  const tree_t *best = best_tree(trees, nb_trees);
+  const double max_score = best->score;
+  population_evaluate_ctx(ctx, trees, nb_trees, ds, max_score);
+	for (int i = 0; i < nb_trees; i++) {
+    if (trees[i]->dominated == 0 && isnan(trees[i]->error) == 0) {
+      MU_CHECK(trees[i]->score <= max_score);
+      MU_CHECK(trees[i]->error == errors[i]);
+    }
+	}
+  MU_CHECK(best->dominated == 0);
+
+	/* Clean up */
+  eval_ctx_delete(ctx);
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+/* Program of ADD(MUL(x, c), x) */
+static program_t *setup_cache_program(const double c) {
+  node_t *mul = node_new_func(MUL, 2);
+  mul->children[0] = node_new_input("x");
+  mul->children[1] = node_new_const(c);
+  node_t *add = node_new_func(ADD, 2);
+  add->children[0] = mul;
+  add->children[1] = node_new_input("x");
+  program_t *p = program_compile(add);
+  node_delete(add);
+  return p;
+}
+
+int test_subtree_cache() {
+  dataset_t ds;
+  ds.nb_rows = 4;
+  ds.generation = 1;
+  const double values[4] = {1.0, 2.0, 3.0, 4.0};
+
+  /* MUL(x, c) is instruction 2 of each program */
+  program_t *programs[20];
+  for (int i = 0; i < 20; i++) {
+    programs[i] = setup_cache_program(i);
+  }
+  program_t *p = programs[1];
+
+  /* Budget for two entries with values */
+  const size_t entry_bytes = CACHE_ENTRY_SIZE(3) + sizeof(double) * 4;
+  subtree_cache_t *cache = subtree_cache_new(2 * entry_bytes + CACHE_ENTRY_SIZE(3));
+  subtree_cache_bind(cache, &ds);
+
+  /* Admitted on the second sighting */
+  subtree_cache_store(cache, p, 2, 0, 2, values);
+  MU_CHECK(subtree_cache_lookup(cache, p, 2, 0, 2) == NULL);
+  subtree_cache_store(cache, p, 2, 0, 2, values);
+  const double *data = subtree_cache_lookup(cache, p, 2, 0, 2);
+  MU_CHECK(data != NULL && data[1] == 2.0);
+  MU_CHECK(cache->admissions == 1);
+
+  /* Rows are filled in order */
+  MU_CHECK(subtree_cache_lookup(cache, p, 2, 2, 2) == NULL);
+  subtree_cache_store(cache, p, 2, 2, 2, values + 2);
+  data = subtree_cache_lookup(cache, p, 2, 2, 2);
+  MU_CHECK(data != NULL && data[1] == 4.0);
+  MU_CHECK(subtree_cache_lookup(cache, programs[2], 2, 0, 2) == NULL);
+  MU_CHECK(cache->hits == 2);
+  MU_CHECK(cache->misses == 3);
+
+  /* A subtree whose hash collides misses and gets its own entry */
+  program_t *q = programs[3];
+  const uint64_t hash = q->hash[2];
+  q->hash[2] = p->hash[2];
+  MU_CHECK(subtree_cache_lookup(cache, q, 2, 0, 4) == NULL);
+  MU_CHECK(cache->collisions == 1);
+  subtree_cache_store(cache, q, 2, 0, 4, values);
+  subtree_cache_store(cache, q, 2, 0, 4, values);
+  MU_CHECK(cache->nb_entries == 2);
+  data = subtree_cache_lookup(cache, q, 2, 0, 4);
+  MU_CHECK(data != NULL && data != subtree_cache_lookup(cache, p, 2, 0, 4));
+  q->hash[2] = hash;
+
+  /* Over budget entries are evicted */
+  for (int i = 10; i < 20; i++) {
+    cache->epoch++;
+    subtree_cache_store(cache, programs[i], 2, 0, 4, values);
+    subtree_cache_store(cache, programs[i], 2, 0, 4, values);
+  }
+  MU_CHECK(cache->bytes <= cache->budget);
+  MU_CHECK(cache->evictions > 0);
+  MU_CHECK(subtree_cache_lookup(cache, programs[19], 2, 0, 4) != NULL);
+
+  /* Another binding clears it, even at the same address */
+  ds.generation = 2;
+  subtree_cache_bind(cache, &ds);
+  MU_CHECK(cache->nb_entries == 0);
+  MU_CHECK(cache->bytes == 0);
+  subtree_cache_print(cache);
+
+  subtree_cache_delete(cache);
+  for (int i = 0; i < 20; i++) {
+    program_delete(programs[i]);
+  }
+
+  return 0;
+}
+
+int test_population_evaluate_cached() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+  /* F(MUL(SIN(x), x), c) for every function F and a few constants c */
+	const int nb_trees = 20;
+	tree_t *trees[20];
+	for (int i = 0; i < nb_trees; i++) {
+    node_t *mul = node_new_func(MUL, 2);
+    node_t *sin_ = node_new_func(SIN, 1);
+    sin_->children[0] = node_new_input("x");
+    mul->children[0] = sin_;
+    mul->children[1] = node_new_input("x");
+
+    node_t *root = node_new_func(i % 5, 2);
+    root->children[0] = mul;
+    root->children[1] = node_new_const(i / 5);
+
+    trees[i] = tree_new();
+    trees[i]->root = root;
+    tree_update(trees[i]);
+	}
+
+  /* Reference errors, tiles of 2 rows */
+  eval_ctx_t *ctx = eval_ctx_new();
+  ctx->tile_rows = 2;
+  double errors[20];
+  population_evaluate_ctx(ctx, trees, nb_trees, ds, INFINITY);
+	for (int i = 0; i < nb_trees; i++) {
+    errors[i] = trees[i]->error;
+	}
+
+  /* Cached evaluation gives the same errors */
+  subtree_cache_t *cache = subtree_cache_new(1024 * 1024);
+  ctx->cache = cache;
+  for (int generation = 0; generation < 2; generation++) {
+    population_evaluate_ctx(ctx, trees, nb_trees, ds, INFINITY);
+	  for (int i = 0; i < nb_trees; i++) {
+      MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+	  }
+
+    /* The shared subtrees are admitted by the second tree, in the first
+     * tile every later tree reads MUL(SIN(x), x) from the cache and in the
+     * next tiles every tree but the one filling it */
+    if (generation == 0) {
+      MU_CHECK(cache->admissions == 2);
+      MU_CHECK(cache->hits == (nb_trees - 2) + 2 * (nb_trees - 1));
+    }
+  }
+
+	/* Clean up */
+  eval_ctx_delete(ctx);
+  subtree_cache_delete(cache);
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+  }
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_evaluate_tree_incremental() {
+  /* Load dataset */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+	/* ADD(MUL(SIN(x), x), COS(x)) */
+  tree_t *t = tree_new();
+  node_t *add = node_new_func(ADD, 2);
+  node_t *mul = node_new_func(MUL, 2);
+  node_t *sin_ = node_new_func(SIN, 1);
+  node_t *cos_ = node_new_func(COS, 1);
+  add->children[0] = mul;
+  add->children[1] = cos_;
+  mul->children[0] = sin_;
+  mul->children[1] = node_new_input("x");
+  sin_->children[0] = node_new_input("x");
+  cos_->children[0] = node_new_input("x");
+  t->root = add;
+  tree_update(t);
+
+  /* Same error as evaluating the program on all rows */
+  eval_ctx_t *ctx = eval_ctx_new();
+  ctx->tile_rows = 0;
+  evaluate_tree_ctx(ctx, t, ds, INFINITY);
+  const double error = t->error;
+  evaluate_tree_incremental(t, ds);
+  MU_CHECK(t->error == error);
+  MU_CHECK(add->output_valid && mul->output_valid && cos_->output_valid);
+
+  /* Changing COS only invalidates it and the root */
+  cos_->function = EXP;
+  node_invalidate(cos_);
+  tree_invalidate(t);
+  MU_CHECK(add->output_valid == 0 && cos_->output_valid == 0);
+  MU_CHECK(mul->output_valid && sin_->output_valid);
+
+  /* Re-evaluation reuses MUL's output */
+  const double *mul_output = mul->output;
+  evaluate_tree_ctx(ctx, t, ds, INFINITY);
+  const double error2 = t->error;
+  evaluate_tree_incremental(t, ds);
+  MU_CHECK(t->error == error2);
+  MU_CHECK(mul->output == mul_output);
+
+  mul->output[0] += 6.0;
+  add->output_valid = 0;
+  evaluate_tree_incremental(t, ds);
+  MU_CHECK(t->error != error2);
+
+  /* Copies share the outputs, a stale shared output is not overwritten */
+  tree_t *t2 = tree_copy(t);
+  MU_CHECK(t2->root->output_valid && t2->root->children[0]->output_valid);
+  MU_CHECK(t2->root->output == add->output);
+  MU_CHECK(t2->root->children[0]->output == mul->output);
+  const double add_output = add->output[0];
+  t2->root->children[1]->function = COS;
+  node_invalidate(t2->root->children[1]);
+  tree_invalidate(t2);
+  evaluate_tree_incremental(t2, ds);
+  MU_CHECK(t2->root->output != add->output);
+  MU_CHECK(t2->root->children[0]->output == mul->output);
+  MU_CHECK(add->output[0] == add_output);
+
+  /* Release */
+  tree_release_outputs(t);
+  MU_CHECK(add->output == NULL && add->output_valid == 0);
+
+  /* Population of trees, same errors as evaluating the programs */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	tree_t *trees[20];
+  double errors[20];
+	for (int i = 0; i < 20; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+    evaluate_tree_ctx(ctx, trees[i], ds, INFINITY);
+    errors[i] = trees[i]->error;
+	}
+  population_evaluate_incremental(trees, 20, ds);
+	for (int i = 0; i < 20; i++) {
+    MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+    MU_CHECK(trees[i]->ds_generation == ds->generation);
+    tree_delete(trees[i]);
+	}
+	free_function_set(fs);
+	free_terminal_set(ts);
+
+	/* Clean up */
+  eval_ctx_delete(ctx);
+	tree_delete(t2);
+	tree_delete(t);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_kernels_accuracy() {
+  /* Odd length to go through the vector tail */
+  const int n = 1001;
+  double x[1001], y[1001], z[1001];
+
+  for (int simd = SIMD_NONE; simd <= SIMD_AVX512; simd++) {
+    if (kernels_select(simd) != 0) {
+      continue;
+    }
+
+    for (int i = 0; i < n; i++) x[i] = -745.0 + 1454.7 * i / (n - 1);
+    MU_CHECK(kernel_max_ulp(&kernels[EXP], x, NULL, n, ref_exp) <= 1.0);
+
+    for (int i = 0; i < n; i++) x[i] = exp(-700.0 + 1400.0 * i / (n - 1));
+    MU_CHECK(kernel_max_ulp(&kernels[LOG], x, NULL, n, ref_log) <= 1.0);
+
+    for (int i = 0; i < n; i++) x[i] = -1000.0 + 2000.0 * i / (n - 1);
+    MU_CHECK(kernel_max_ulp(&kernels[SIN], x, NULL, n, ref_sin) <= 2.0);
+    MU_CHECK(kernel_max_ulp(&kernels[COS], x, NULL, n, ref_cos) <= 2.0);
+
+    /* |y * log(x)| <= 14 */
+    for (int i = 0; i < n; i++) {
+      x[i] = 0.01 + 100.0 * i / (n - 1);
+      y[i] = -3.0 + 6.0 * ((i * 7919) % n) / (n - 1);
+    }
+    MU_CHECK(kernel_max_ulp(&kernels[POW], x, y, n, pow) <= 32.0);
+
+    /* Special values */
+    x[0] = INFINITY, x[1] = -INFINITY, x[2] = 0.0, x[3] = -1.0, x[4] = NAN;
+    kernels[EXP].vv(x, NULL, z, 5);
+    MU_CHECK(isinf(z[0]) && z[1] == 0.0 && z[2] == 1.0 && isnan(z[4]));
+    kernels[LOG].vv(x, NULL, z, 5);
+    MU_CHECK(isinf(z[0]) && isnan(z[1]) && z[2] == -INFINITY && isnan(z[3]));
+    kernels[POW].vs(x + 2, 2.0, z, 2);
+    MU_CHECK(z[0] == 0.0 && z[1] == 1.0);
+    kernels[POW].sv(2.0, x + 2, z, 2);
+    MU_CHECK(z[0] == 1.0 && z[1] == 0.5);
+  }
+  kernels_select(simd_detect());
+
+  return 0;
+}
+
+int test_kernels_select() {
+  /* Scalar kernels are always available, unknown instruction sets never */
+  MU_CHECK(kernels_select(SIMD_NONE) == 0);
+  MU_CHECK(kernels == kernels_scalar);
+  MU_CHECK(kernels_select(-1) == -1);
+  MU_CHECK(kernels_select(SIMD_AVX512 + 1) == -1);
+  MU_CHECK(simd_supported(simd_detect()));
+
+  /* Vector kernels give the same results whatever the instruction set */
+  const int n = 13;
+  double x[13], y[13], z[13], z_ref[13];
+  for (int i = 0; i < n; i++) {
+    x[i] = 0.5 + i * 1.7;
+    y[i] = -2.0 + i * 0.3;
+  }
+
+  const int simd_ref = simd_detect();
+  for (int simd = SIMD_SSE2; simd < simd_ref; simd++) {
+    for (int f = ADD; f <= COS; f++) {
+      if (simd == SIMD_SSE2 && (f == POW || f == LOG)) {
+        continue; /* libm */
+      }
+      kernels_select(simd_ref);
+      kernels[f].vv(x, y, z_ref, n);
+      kernels_select(simd);
+      kernels[f].vv(x, y, z, n);
+      MU_CHECK(memcmp(z, z_ref, sizeof(z)) == 0);
+    }
+  }
+  kernels_select(simd_detect());
+
+  return 0;
+}
+
+static void test_threadpool_task(void *arg, const int task, const int worker) {
+  (void) worker;
+  int *counts = (int *) arg;
+  counts[task]++;
+}
+
+int test_threadpool_run() {
+  threadpool_t *pool = threadpool_new(4);
+  MU_CHECK(pool->nb_threads == 4);
+
+  /* The pool is reused, every task runs once per job */
+  int counts[100] = {0};
+  for (int job = 0; job < 10; job++) {
+    threadpool_run(pool, test_threadpool_task, counts, 100);
+  }
+  for (int i = 0; i < 100; i++) {
+    MU_CHECK(counts[i] == 10);
+  }
+
+  /* Every task is counted once, by the worker that ran it */
+  long tasks = 0;
+  for (int i = 0; i < pool->nb_threads; i++) {
+    MU_CHECK(pool->stats[i].steals <= pool->stats[i].tasks);
+    MU_CHECK(pool->stats[i].busy >= 0.0);
+    tasks += pool->stats[i].tasks;
+  }
+  MU_CHECK(tasks == 1000);
+  MU_CHECK(pool->nb_jobs == 10);
+  threadpool_stats_print(pool);
+  threadpool_stats_reset(pool);
+  MU_CHECK(pool->stats[0].tasks == 0 && pool->nb_jobs == 0);
+  threadpool_delete(pool);
+
+  /* One thread per CPU by default */
+  pool = threadpool_new(0);
+  MU_CHECK(pool->nb_threads >= 1);
+  threadpool_delete(pool);
+
+  return 0;
+}
+
+typedef struct test_spawn_t {
+  threadpool_t *pool;
+  atomic_int counts[100];
+} test_spawn_t;
+
+static void test_threadpool_spawn_task(void *arg, const int task, const int worker) {
+  test_spawn_t *job = (test_spawn_t *) arg;
+  atomic_fetch_add(&job->counts[task], 1);
+
+  /* Tasks 0 to 9 spawn tasks 10 to 99 */
+  for (int i = 0; task < 10 && i < 9; i++) {
+    threadpool_spawn(job->pool, worker, 10 + task * 9 + i);
+  }
+}
+
+int test_threadpool_spawn() {
+  threadpool_t *pool = threadpool_new(3);
+  test_spawn_t job;
+  job.pool = pool;
+  for (int i = 0; i < 100; i++) {
+    atomic_init(&job.counts[i], 0);
+  }
+
+  /* Spawned tasks run before the job returns */
+  threadpool_run(pool, test_threadpool_spawn_task, &job, 10);
+  long tasks = 0;
+  for (int i = 0; i < pool->nb_threads; i++) {
+    tasks += pool->stats[i].tasks;
+  }
+  MU_CHECK(tasks == 100);
+  for (int i = 0; i < 100; i++) {
+    MU_CHECK(atomic_load(&job.counts[i]) == 1);
+  }
+  threadpool_delete(pool);
+
+  return 0;
+}
+
+int test_population_evaluate_pool() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Load dataset and generate trees */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+	const int nb_trees = 100;
+	tree_t *trees[100];
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 4);
+	}
+
+  /* Serial reference */
+  double errors[100];
+  population_evaluate(trees, nb_trees, ds);
+	for (int i = 0; i < nb_trees; i++) {
+    errors[i] = trees[i]->error;
+	}
+
+  /* Same errors whatever the number of threads */
+  for (int nb_threads = 1; nb_threads <= 4; nb_threads++) {
+    threadpool_t *pool = threadpool_new(nb_threads);
+	  for (int i = 0; i < nb_trees; i++) {
+      tree_invalidate(trees[i]);
+      trees[i]->error = 0.0;
+	  }
+    population_evaluate_pool(pool, trees, nb_trees, ds, INFINITY);
+	  for (int i = 0; i < nb_trees; i++) {
+      MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+	  }
+    threadpool_delete(pool);
+  }
+
+	/* Clean up */
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+/* Dataset of `nb_rows` rows of y = x^2 + 1 */
+static dataset_t *setup_dataset(const int nb_rows) {
+  dataset_t *ds = (dataset_t *) malloc(sizeof(dataset_t));
+  ds->nb_rows = nb_rows;
+  ds->nb_cols = 2;
+  ds->data = (double **) malloc(sizeof(double *) * 2);
+  ds->fields = (char **) malloc(sizeof(char *) * 2);
+  ds->fields[0] = malloc_string("x");
+  ds->fields[1] = malloc_string("y");
+  ds->predict = malloc_string("y");
+  for (int j = 0; j < 2; j++) {
+    ds->data[j] = (double *) malloc(sizeof(double) * nb_rows);
+  }
+  for (int i = 0; i < nb_rows; i++) {
+    const double x = -10.0 + 20.0 * i / nb_rows;
+    ds->data[0][i] = x;
+    ds->data[1][i] = x * x + 1.0;
+  }
+  ds->inputs = NULL;
+  dataset_bind(ds);
+  ds->shm = NULL;
+  ds->shm_size = 0;
+  return ds;
+}
+
+int test_population_evaluate_blocks() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Tiles of 4 rows make blocks of 256 rows, the last block is partial */
+  dataset_t *ds = setup_dataset(2000);
+  eval_ctx_t *ctx = eval_ctx_default();
+  const int tile_rows = ctx->tile_rows;
+  ctx->tile_rows = 4;
+
+  /* Small trees and one tree that dominates the evaluation cost */
+	const int nb_trees = 20;
+	tree_t *trees[20];
+	for (int i = 0; i < nb_trees - 1; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+  trees[nb_trees - 1] = tree_generate(&rng, FULL, fs, ts, 7);
+
+  /* Serial reference */
+  double errors[20];
+  population_evaluate(trees, nb_trees, ds);
+	for (int i = 0; i < nb_trees; i++) {
+    errors[i] = trees[i]->error;
+	}
+
+  /* Same errors whatever the number of threads */
+  for (int nb_threads = 1; nb_threads <= 4; nb_threads++) {
+    threadpool_t *pool = threadpool_new(nb_threads);
+	  for (int i = 0; i < nb_trees; i++) {
+      tree_invalidate(trees[i]);
+      trees[i]->error = 0.0;
+	  }
+    population_evaluate_pool(pool, trees, nb_trees, ds, INFINITY);
+	  for (int i = 0; i < nb_trees; i++) {
+      if (isnan(errors[i])) {
+        MU_CHECK(isnan(trees[i]->error)); /* Sign of NaN is not kept */
+      } else {
+        MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+      }
+      MU_CHECK(trees[i]->dominated == 0 || isnan(errors[i]));
+	  }
+
+    /* The large tree is split over the 8 blocks */
+    long tasks = 0;
+    for (int i = 0; i < pool->nb_threads; i++) {
+      tasks += pool->stats[i].tasks;
+    }
+    MU_CHECK(tasks >= 8);
+    threadpool_delete(pool);
+  }
+
+  /* A bound keeps the errors of the trees that meet it */
+  double max_score = INFINITY;
+	for (int i = 0; i < nb_trees && isfinite(max_score) == 0; i++) {
+    max_score = isfinite(trees[i]->score) ? trees[i]->score : INFINITY;
+  }
+  threadpool_t *pool = threadpool_new(2);
+  population_evaluate_pool(pool, trees, nb_trees, ds, max_score);
+	for (int i = 0; i < nb_trees; i++) {
+    if (isnan(errors[i])) {
+      continue;
+    } else if (trees[i]->dominated == 0) {
+      MU_CHECK(trees[i]->score <= max_score);
+      MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+    } else {
+      MU_CHECK(trees[i]->error == INFINITY && trees[i]->score == INFINITY);
+    }
+	}
+  threadpool_delete(pool);
+
+	/* Clean up */
+  ctx->tile_rows = tile_rows;
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_population_evolve_pool() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  threadpool_t *pool = threadpool_new(3);
+
+  /* Breeding then evaluating, and the pipeline from the same stream */
+  const int nb_trees = 150;
+  tree_t **trees[2];
+  for (int k = 0; k < 2; k++) {
+    rng_t stream;
+    rng_seed(&stream, 7);
+    trees[k] = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	  for (int i = 0; i < nb_trees; i++) {
+      trees[k][i] = tree_generate(&stream, GROW, fs, ts, 3);
+	  }
+    population_evaluate_pool(pool, trees[k], nb_trees, ds, INFINITY);
+
+    for (int gen = 0; gen < 3; gen++) {
+      const double max_score = best_tree(trees[k], nb_trees)->score;
+      if (k == 0) {
+        trees[k] = population_vary(&stream, trees[k], nb_trees, fs, ts, 3, 0.5, 0.5);
+        population_evaluate_pool(pool, trees[k], nb_trees, ds, max_score);
+      } else {
+        trees[k] = population_evolve_pool(pool, &stream, trees[k], nb_trees, fs, ts, ds,
+                                          3, 0.5, 0.5, max_score);
+      }
+    }
+  }
+
+  /* Same trees, errors and bounds */
+	for (int i = 0; i < nb_trees; i++) {
+    char *expected = tree_string(trees[0][i]);
+    char *str = tree_string(trees[1][i]);
+    MU_CHECK(strcmp(str, expected) == 0);
+    MU_CHECK(trees[1][i]->dominated == trees[0][i]->dominated);
+    MU_CHECK(trees[1][i]->error == trees[0][i]->error ||
+             (isnan(trees[1][i]->error) && isnan(trees[0][i]->error)));
+    free(expected);
+    free(str);
+	}
+
+	/* Clean up */
+  for (int k = 0; k < 2; k++) {
+	  for (int i = 0; i < nb_trees; i++) {
+      tree_delete(trees[k][i]);
+    }
+    free(trees[k]);
+  }
+  threadpool_delete(pool);
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_node_cache() {
+  /* Freed nodes are reused by the same thread */
+  node_t *n = node_new_const(1.0);
+  node_delete(n);
+  node_t *m = node_new_input("x");
+  MU_CHECK(m == n);
+  MU_CHECK(m->parent == NULL && m->output == NULL && m->children[0] == NULL);
+  node_delete(m);
+  node_cache_release();
+
+  return 0;
+}
+
+static void *test_node_arena_worker(void *arg) {
+  node_t **n = (node_t **) arg;
+  *n = node_new_const(2.0);
+  node_delete(*n);
+  node_cache_release();
+  return NULL;
+}
+
+int test_node_arena() {
+  /* Nodes of a fresh slab are contiguous */
+  node_arena_reset();
+  node_t *a = node_new_const(1.0);
+  node_t *b = node_new_const(1.0);
+  MU_CHECK(b == a + 1);
+  MU_CHECK(node_arena.nb_slabs == 1);
+  node_delete(a);
+  node_delete(b);
+
+  /* A thread takes its own slab and hands it back when done */
+  pthread_t thread;
+  node_t *n = NULL;
+  pthread_create(&thread, NULL, test_node_arena_worker, &n);
+  pthread_join(thread, NULL);
+  MU_CHECK(node_arena.nb_slabs == 2);
+  MU_CHECK(node_arena.free != NULL);
+
+  /* Nodes handed back are reused before a new slab */
+  node_cache_release();
+  node_t *c = node_new_const(1.0);
+  MU_CHECK(node_arena.nb_slabs == 2);
+  node_delete(c);
+
+  /* A thread keeps at most NODE_CACHE_SIZE free nodes, the rest spill */
+  const int nb_nodes = 3 * NODE_CACHE_SIZE;
+  node_t **nodes = (node_t **) malloc(sizeof(node_t *) * nb_nodes);
+  for (int i = 0; i < nb_nodes; i++) {
+    nodes[i] = node_new_const(1.0);
+  }
+  const int nb_slabs = node_arena.nb_slabs;
+  node_cache_release();
+  for (int i = 0; i < nb_nodes; i++) {
+    node_delete(nodes[i]);
+    MU_CHECK(node_cache_length <= NODE_CACHE_SIZE);
+  }
+  MU_CHECK(node_cache_length >= NODE_CACHE_SIZE / 2);
+  MU_CHECK(node_arena.free != NULL);
+
+  /* Another thread refills from the spilled nodes */
+  pthread_create(&thread, NULL, test_node_arena_worker, &n);
+  pthread_join(thread, NULL);
+  MU_CHECK(node_arena.nb_slabs == nb_slabs);
+  free(nodes);
+
+  /* Nodes after a reset come from a new slab */
+  node_arena_reset();
+  MU_CHECK(node_arena.nb_slabs == 0);
+  c = node_new_const(1.0);
+  MU_CHECK(node_arena.nb_slabs == 1);
+  node_delete(c);
+
+  return 0;
+}
+
+int test_population_vary() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+  /* Same generation serially and whatever the number of threads */
+  const int nb_trees = 150;
+  char *expected[150];
+  for (int nb_threads = 0; nb_threads <= 3; nb_threads++) {
+    rng_t stream;
+    rng_seed(&stream, 42);
+    tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	  for (int i = 0; i < nb_trees; i++) {
+      trees[i] = tree_generate(&stream, GROW, fs, ts, 3);
+	  }
+    population_evaluate(trees, nb_trees, ds);
+
+    if (nb_threads == 0) {
+      trees = population_vary(&stream, trees, nb_trees, fs, ts, 3, 0.5, 0.5);
+    } else {
+      threadpool_t *pool = threadpool_new(nb_threads);
+      trees = population_vary_pool(pool, &stream, trees, nb_trees, fs, ts, 3, 0.5, 0.5);
+      threadpool_delete(pool);
+    }
+
+	  for (int i = 0; i < nb_trees; i++) {
+      char *str = tree_string(trees[i]);
+      if (nb_threads == 0) {
+        expected[i] = str;
+      } else {
+        MU_CHECK(strcmp(str, expected[i]) == 0);
+        free(str);
+      }
+
+      /* Next generation is packed */
+      MU_CHECK(trees[i]->root == NULL && trees[i]->nodes != NULL);
+      tree_unpack(trees[i]);
+      MU_CHECK(subtree_size(trees[i]->root) == trees[i]->size);
+      tree_delete(trees[i]);
+	  }
+    free(trees);
+  }
+
+  /* Generations evaluated incrementally stay unpacked and share outputs */
+  tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+  population_evaluate_incremental(trees, nb_trees, ds);
+  trees = population_vary(&rng, trees, nb_trees, fs, ts, 3, 0.5, 0.5);
+  int nb_reused = 0;
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(trees[i]->root != NULL && trees[i]->nodes == NULL);
+    MU_CHECK(trees[i]->ds_generation == ds->generation);
+    nb_reused += (trees[i]->root->type == FUNC_NODE && trees[i]->root->children[0]->output_valid);
+	}
+  MU_CHECK(nb_reused > 0);
+  population_evaluate_incremental(trees, nb_trees, ds);
+	for (int i = 0; i < nb_trees; i++) {
+    const double error = trees[i]->error;
+    evaluate_tree(trees[i], ds);
+    if (isnan(error) || isinf(error)) {
+      MU_CHECK(memcmp(&error, &trees[i]->error, sizeof(double)) == 0 || isnan(trees[i]->error));
+    } else {
+      MU_CHECK(fabs(error - trees[i]->error) <= 1e-9 * fabs(error));
+    }
+    tree_delete(trees[i]);
+	}
+  free(trees);
+
+	/* Clean up */
+	for (int i = 0; i < nb_trees; i++) {
+    free(expected[i]);
+  }
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_population_breed() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+
+  /* Same generations as population_vary(), serially and with threads */
+  const int nb_trees = 150;
+  const int nb_gens = 4;
+  for (int nb_threads = 0; nb_threads <= 2; nb_threads++) {
+    rng_t stream;
+    rng_t expected_stream;
+    rng_seed(&stream, 42);
+    rng_seed(&expected_stream, 42);
+    tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+    tree_t **expected = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	  for (int i = 0; i < nb_trees; i++) {
+      trees[i] = tree_generate(&stream, GROW, fs, ts, 3);
+      expected[i] = tree_generate(&expected_stream, GROW, fs, ts, 3);
+	  }
+    threadpool_t *pool = (nb_threads) ? threadpool_new(nb_threads) : NULL;
+    population_t *pop = population_new(trees, nb_trees);
+    tree_t *const storage = pop->storage;
+    tree_t **const front = pop->trees;
+    tree_t **const back = pop->next;
+
+    for (int gen = 0; gen < nb_gens; gen++) {
+      population_evaluate(pop->trees, nb_trees, ds);
+      population_evaluate(expected, nb_trees, ds);
+      population_breed(pop, pool, &stream, fs, ts, 3, 0.5, 0.5);
+      expected = population_vary(&expected_stream, expected, nb_trees, fs, ts, 3, 0.5, 0.5);
+
+      /* Generations swap in place */
+      MU_CHECK(pop->generation == gen + 1);
+      MU_CHECK(pop->storage == storage);
+      MU_CHECK(pop->trees == ((gen % 2 == 0) ? back : front));
+      MU_CHECK(pop->next == ((gen % 2 == 0) ? front : back));
+      for (int i = 0; i < nb_trees; i++) {
+        MU_CHECK(pop->trees[i] >= storage && pop->trees[i] < storage + 2 * nb_trees);
+        MU_CHECK(pop->trees[i]->nodes != NULL);
+
+        char *str = tree_string(pop->trees[i]);
+        char *expected_str = tree_string(expected[i]);
+        MU_CHECK(strcmp(str, expected_str) == 0);
+        free(str);
+        free(expected_str);
+      }
+    }
+
+	  for (int i = 0; i < nb_trees; i++) {
+      tree_delete(expected[i]);
+	  }
+    free(expected);
+    population_delete(pop);
+    if (pool) {
+      threadpool_delete(pool);
+    }
+  }
+
+	/* Clean up */
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+static void *test_spsc_queue_producer(void *arg) {
+  spsc_queue_t *q = (spsc_queue_t *) arg;
+  for (intptr_t i = 1; i <= 100000; i++) {
+    while (spsc_queue_push(q, (void *) i) != 0) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int test_spsc_queue() {
+  /* First in, first out, pushing to a full queue fails */
+  spsc_queue_t *q = spsc_queue_new(4);
+  int items[5] = {0, 1, 2, 3, 4};
+  MU_CHECK(spsc_queue_pop(q) == NULL);
+  for (int i = 0; i < 4; i++) {
+    MU_CHECK(spsc_queue_push(q, &items[i]) == 0);
+  }
+  MU_CHECK(spsc_queue_push(q, &items[4]) == -1);
+  for (int i = 0; i < 4; i++) {
+    MU_CHECK(spsc_queue_pop(q) == &items[i]);
+  }
+  MU_CHECK(spsc_queue_pop(q) == NULL);
+
+  /* Items pushed by another thread arrive in order */
+  pthread_t producer;
+  pthread_create(&producer, NULL, test_spsc_queue_producer, q);
+  for (intptr_t i = 1; i <= 100000; i++) {
+    void *item;
+    while ((item = spsc_queue_pop(q)) == NULL) {
+      sched_yield();
+    }
+    MU_CHECK((intptr_t) item == i);
+  }
+  pthread_join(producer, NULL);
+  MU_CHECK(spsc_queue_pop(q) == NULL);
+  spsc_queue_delete(q);
+
+  return 0;
+}
+
+int test_numa() {
+  numa_t *numa = numa_detect();
+  MU_CHECK(numa->nb_nodes >= 1);
+  MU_CHECK(numa->cpu_node[sched_getcpu()] >= 0);
+  MU_CHECK(numa->cpu_node[sched_getcpu()] < numa->nb_nodes);
+
+  /* CPU lists as found in sysfs */
+  for (int cpu = 0; cpu < numa->nb_cpus; cpu++) {
+    numa->cpu_node[cpu] = -1;
+  }
+  numa_parse_cpus(numa, "0-1,3\n", 1);
+  MU_CHECK(numa->cpu_node[0] == 1);
+  MU_CHECK(numa->nb_cpus < 2 || numa->cpu_node[1] == 1);
+  MU_CHECK(numa->nb_cpus < 3 || numa->cpu_node[2] == -1);
+  MU_CHECK(numa->nb_cpus < 4 || numa->cpu_node[3] == 1);
+  numa_delete(numa);
+
+  /* Only CPUs the process may run on */
+  cpu_set_t allowed;
+  MU_CHECK(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0);
+  numa = numa_detect();
+  for (int cpu = 0; cpu < numa->nb_cpus; cpu++) {
+    MU_CHECK(numa->cpu_node[cpu] == -1 || CPU_ISSET(cpu, &allowed));
+  }
+  numa_delete(numa);
+
+  return 0;
+}
+
+int test_population_evaluate_replicas() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+  dataset_t *ds = setup_dataset(2000);
+
+  /* Pin a pool and replicate the dataset on its nodes */
+  cpu_set_t affinity;
+  cpu_set_t restored;
+  MU_CHECK(sched_getaffinity(0, sizeof(cpu_set_t), &affinity) == 0);
+  numa_t *numa = numa_detect();
+  threadpool_t *pool = threadpool_new(3);
+  MU_CHECK(threadpool_pin(pool, numa) == 3);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    MU_CHECK(numa->cpu_node[pool->cpus[i]] == pool->nodes[i]);
+  }
+  dataset_replicas_t *replicas = dataset_replicate(pool, numa, ds);
+  for (int i = 0; i < pool->nb_threads; i++) {
+    const dataset_t *replica = replicas->workers[i];
+    MU_CHECK(replica == replicas->nodes[pool->nodes[i]]);
+    MU_CHECK(replica->data[0] != ds->data[0]);
+    MU_CHECK(replica->target == replica->data[1]);
+    for (int j = 0; j < ds->nb_cols; j++) {
+      MU_CHECK(memcmp(replica->data[j], ds->data[j], sizeof(double) * ds->nb_rows) == 0);
+    }
+  }
+  MU_CHECK(replicas->bandwidth[pool->nodes[0]] > 0.0);
+  dataset_replicas_print(replicas);
+
+  /* Same errors as the serial evaluation */
+	const int nb_trees = 50;
+	tree_t *trees[50];
+  double errors[50];
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 4);
+	}
+  population_evaluate(trees, nb_trees, ds);
+	for (int i = 0; i < nb_trees; i++) {
+    errors[i] = trees[i]->error;
+    trees[i]->error = 0.0;
+	}
+  population_evaluate_replicas(pool, trees, nb_trees, replicas, INFINITY);
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(isnan(errors[i]) ? isnan(trees[i]->error) : trees[i]->error == errors[i]);
+	}
+
+  /* Clean up */
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+	}
+  dataset_replicas_delete(replicas);
+  threadpool_delete(pool);
+  numa_delete(numa);
+
+  /* Deleting the pool unpins the calling thread */
+  MU_CHECK(sched_getaffinity(0, sizeof(cpu_set_t), &restored) == 0);
+  MU_CHECK(CPU_EQUAL(&affinity, &restored));
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_islands() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  threadpool_t *pools[2] = {threadpool_new(1), threadpool_new(3)};
+
+  for (int topology = RING_TOPOLOGY; topology <= FULL_TOPOLOGY; topology++) {
+    /* Same seed on a single thread and on fewer threads than islands */
+    const rng_t seed = rng_split(&rng);
+    islands_t *runs[2];
+    for (int r = 0; r < 2; r++) {
+      rng_t run_rng = seed;
+      islands_t *islands = islands_new(&run_rng, fs, ts, ds, 4, 50, 3, topology);
+      MU_CHECK(islands->nb_queues == ((topology == RING_TOPOLOGY) ? 4 : 12));
+      islands->migration_interval = 2;
+      islands_run(islands, pools[r], 5);
+      islands_run(islands, pools[r], 5);
+      runs[r] = islands;
+    }
+    islands_print(runs[1]);
+
+    /* Every island migrated 5 times to and from each neighbour, and every
+     * migrant sent was received */
+    const int nb_out = (topology == RING_TOPOLOGY) ? 1 : 3;
+    for (int r = 0; r < 2; r++) {
+      for (int i = 0; i < runs[r]->nb_islands; i++) {
+        const island_t *island = &runs[r]->islands[i];
+        MU_CHECK(island->generation == 10);
+        MU_CHECK(island->nb_out == nb_out && island->nb_in == nb_out);
+        MU_CHECK(island->nb_sent == 5 * nb_out * 2);
+        MU_CHECK(island->nb_received == 5 * nb_out * 2);
+        MU_CHECK(island->nb_dropped == 0);
+      }
+    }
+
+    /* Runs do not depend on the number of threads */
+    for (int i = 0; i < runs[0]->nb_islands; i++) {
+      const island_t *a = &runs[0]->islands[i];
+      const island_t *b = &runs[1]->islands[i];
+      for (int j = 0; j < a->nb_trees; j++) {
+        MU_CHECK(a->trees[j]->size == b->trees[j]->size);
+        const double x = a->trees[j]->score;
+        const double y = b->trees[j]->score;
+        MU_CHECK(x == y || (isnan(x) && isnan(y)));
+      }
+    }
+
+    /* Best of all islands */
+    const tree_t *best = islands_best(runs[1]);
+    MU_CHECK(best != NULL);
+    for (int i = 0; i < runs[1]->nb_islands; i++) {
+      const island_t *island = &runs[1]->islands[i];
+      MU_CHECK(tree_better(best_tree(island->trees, island->nb_trees), best) == 0);
+    }
+
+    islands_delete(runs[0]);
+    islands_delete(runs[1]);
+  }
+
+	/* Clean up */
+  threadpool_delete(pools[0]);
+  threadpool_delete(pools[1]);
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_steady_state() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  threadpool_t *pool = threadpool_new(3);
+
+  const int nb_trees = 200;
+  tree_t *trees[200];
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+  steady_state_t *ss = steady_state_new(trees, nb_trees, fs, ts, ds);
+  ss->crossover_rate = 0.5;
+  const double best_score = best_tree(trees, nb_trees)->score;
+
+  /* Evaluation budget, offspring only replace trees they beat */
+  steady_state_run(ss, pool, &rng, 2000, 0.0);
+  MU_CHECK(atomic_load(&ss->nb_evaluations) == 2000);
+  MU_CHECK(atomic_load(&ss->nb_replacements) <= 2000);
+  MU_CHECK(best_tree(trees, nb_trees)->score <= best_score);
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(subtree_size(trees[i]->root) == trees[i]->size);
+	}
+
+  /* Time budget */
+  steady_state_run(ss, pool, &rng, 0, 0.2);
+  MU_CHECK(ss->elapsed >= 0.2);
+  MU_CHECK(atomic_load(&ss->nb_evaluations) > 2000);
+  steady_state_print(ss);
+
+	/* Clean up */
+  steady_state_delete(ss);
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+  }
+  threadpool_delete(pool);
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_steady_state_population() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  threadpool_t *pool = threadpool_new(3);
+
+  const int nb_trees = 100;
+  tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+  population_t *pop = population_new(trees, nb_trees);
+  steady_state_t *ss = steady_state_new_population(pop, fs, ts, ds);
+  ss->crossover_rate = 0.5;
+  const double best_score = best_tree(pop->trees, nb_trees)->score;
+
+  steady_state_run(ss, pool, &rng, 1000, 0.0);
+  steady_state_run(ss, pool, &rng, 1000, 0.0);
+  MU_CHECK(atomic_load(&ss->nb_evaluations) == 2000);
+  MU_CHECK(atomic_load(&ss->nb_replacements) <= 2000);
+  MU_CHECK(best_tree(pop->trees, nb_trees)->score <= best_score);
+
+  /* Offspring and replaced trees only swap places within the population */
+  int seen[200] = {0};
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(pop->trees[i] >= pop->storage && pop->trees[i] < pop->storage + 2 * nb_trees);
+    MU_CHECK(pop->next[i] >= pop->storage && pop->next[i] < pop->storage + 2 * nb_trees);
+    seen[pop->trees[i] - pop->storage]++;
+    seen[pop->next[i] - pop->storage]++;
+    MU_CHECK(pop->trees[i]->nodes[0].len == pop->trees[i]->size);
+    MU_CHECK(isfinite(pop->trees[i]->score) || pop->trees[i]->dominated);
+	}
+  for (int i = 0; i < 2 * nb_trees; i++) {
+    MU_CHECK(seen[i] == 1);
+  }
+
+	/* Clean up */
+  steady_state_delete(ss);
+  population_delete(pop);
+  threadpool_delete(pool);
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_dataset_shm() {
+  dataset_t *ds = setup_dataset(1000);
+  char name[64];
+  snprintf(name, 64, "/sr-test-%d", (int) getpid());
+  MU_CHECK(dataset_shm_create(ds, name) == 0);
+  MU_CHECK(dataset_shm_create(ds, name) == -1); /* Already exists */
+
+  /* Attached dataset has the same fields and columns */
+  dataset_t *shared = dataset_shm_attach(name);
+  MU_CHECK(shared != NULL);
+  MU_CHECK(shared->nb_rows == ds->nb_rows);
+  MU_CHECK(shared->nb_cols == ds->nb_cols);
+  MU_CHECK(strcmp(shared->predict, "y") == 0);
+  for (int j = 0; j < ds->nb_cols; j++) {
+    MU_CHECK(strcmp(shared->fields[j], ds->fields[j]) == 0);
+    MU_CHECK(memcmp(shared->data[j], ds->data[j], sizeof(double) * ds->nb_rows) == 0);
+  }
+  MU_CHECK(shared->target == shared->data[1]);
+  MU_CHECK(((uintptr_t) shared->data[0] % 64) == 0);
+
+  dataset_delete(shared);
+  dataset_shm_unlink(name);
+  MU_CHECK(dataset_shm_attach(name) == NULL);
+  dataset_delete(ds);
+
+  return 0;
+}
+
+int test_population_evaluate_procs() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+  dataset_t *ds = setup_dataset(1000);
+
+  /* Serial reference */
+	const int nb_trees = 50;
+	tree_t *trees[50];
+  double errors[50];
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, RAMPED_HALF_AND_HALF, fs, ts, 4);
+	}
+  population_evaluate(trees, nb_trees, ds);
+	for (int i = 0; i < nb_trees; i++) {
+    errors[i] = trees[i]->error;
+	}
+
+  /* Worker processes give the same errors */
+  procpool_t *pool = procpool_new(ds, 3);
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i]->error = 0.0;
+	}
+  population_evaluate_procs(pool, trees, nb_trees, INFINITY);
+	for (int i = 0; i < nb_trees; i++) {
+    if (isnan(errors[i])) {
+      MU_CHECK(isnan(trees[i]->error));
+    } else {
+      MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+    }
+	}
+
+  /* A corrupt program only fails the batch of its worker */
+  const int op = trees[0]->program->code[0].op;
+  trees[0]->program->code[0].op = 99;
+  population_evaluate_procs(pool, trees, nb_trees, INFINITY);
+  trees[0]->program->code[0].op = op;
+  MU_CHECK(pool->nb_restarts == 1);
+	for (int i = 0; i < nb_trees; i++) {
+    if (i < nb_trees / 3) {
+      MU_CHECK(isinf(trees[i]->error) && isinf(trees[i]->score));
+      MU_CHECK(trees[i]->dominated);
+    } else if (isnan(errors[i])) {
+      MU_CHECK(isnan(trees[i]->error));
+    } else {
+      MU_CHECK(memcmp(&trees[i]->error, &errors[i], sizeof(double)) == 0);
+    }
+	}
+
+  /* Programs that would underflow the stack or outgrow their depth too */
+  trees[0]->program->code[0].op = ADD;
+  population_evaluate_procs(pool, trees, nb_trees, INFINITY);
+  trees[0]->program->code[0].op = op;
+  MU_CHECK(pool->nb_restarts == 2);
+  int deep = nb_trees / 3;
+  while (trees[deep]->program->depth < 2) {
+    deep++;
+  }
+  trees[deep]->program->depth--;
+  population_evaluate_procs(pool, trees, nb_trees, INFINITY);
+  trees[deep]->program->depth++;
+  MU_CHECK(pool->nb_restarts == 3);
+  MU_CHECK(trees[deep]->dominated && isinf(trees[deep]->score));
+
+  /* Trees of a killed worker lose to every scored tree */
+  kill(pool->pids[1], SIGKILL);
+  population_evaluate_procs(pool, trees, nb_trees, 1.0);
+  MU_CHECK(pool->nb_restarts == 4);
+	for (int i = nb_trees / 3; i < 2 * nb_trees / 3; i++) {
+    MU_CHECK(trees[i]->dominated && isinf(trees[i]->score));
+    for (int k = 0; k < nb_trees; k++) {
+      if ((k < nb_trees / 3 || k >= 2 * nb_trees / 3) && isfinite(trees[k]->score)) {
+        MU_CHECK(tree_better(trees[k], trees[i]));
+        MU_CHECK(tree_better(trees[i], trees[k]) == 0);
+      }
+    }
+	}
+
+  /* The restarted workers evaluate again */
+  population_evaluate_procs(pool, trees, nb_trees, INFINITY);
+  MU_CHECK(pool->nb_restarts == 4);
+	for (int i = 0; i < nb_trees; i++) {
+    MU_CHECK(isnan(errors[i]) ? isnan(trees[i]->error) : trees[i]->error == errors[i]);
+	}
+
+  /* Clean up */
+  procpool_delete(pool);
+	for (int i = 0; i < nb_trees; i++) {
+    tree_delete(trees[i]);
+	}
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_best_tree() {
+  /* Setup trees */
+  tree_t **trees = (tree_t **) malloc(sizeof(tree_t) * 10);
+  for (int i = 0; i < 10; i++) {
+    trees[i] = tree_new();
+    trees[i]->score = i;
+  }
+
+  /* Find best */
+  tree_t *best = best_tree(trees, 10);
+  MU_CHECK(fltcmp(best->score, 0.0) == 0);
+
+  /* NaN scores are never best */
+  trees[0]->score = NAN;
+  trees[5]->score = NAN;
+  best = best_tree(trees, 10);
+  MU_CHECK(best == trees[1]);
+
+  /* The first of equally good trees */
+  trees[7]->score = 1.0;
+  best = best_tree(trees, 10);
+  MU_CHECK(best == trees[1]);
+
+  /* Only NaN scores, the first tree */
+  for (int i = 0; i < 10; i++) {
+    trees[i]->score = NAN;
+  }
+  MU_CHECK(best_tree(trees, 10) == trees[0]);
+
+  /* NaN ranks below any score, dominated trees below the others */
+  trees[1]->score = 2.0;
+  MU_CHECK(tree_better(trees[1], trees[0]) && tree_better(trees[0], trees[1]) == 0);
+  MU_CHECK(tree_better(trees[0], trees[2]) == 0 && tree_better(trees[2], trees[0]) == 0);
+  trees[1]->dominated = 1;
+  MU_CHECK(tree_better(trees[0], trees[1]) && tree_better(trees[1], trees[0]) == 0);
+
+  /* Dominated trees are equal whatever their scores */
+  trees[2]->dominated = 1;
+  trees[2]->score = 1.0;
+  MU_CHECK(tree_better(trees[1], trees[2]) == 0 && tree_better(trees[2], trees[1]) == 0);
+
+  /* Clean up */
+  for (int i = 0; i < 10; i++) {
+    tree_delete(trees[i]);
+  }
+  free(trees);
+
+  return 0;
+}
+
+int test_selection_bound() {
+  tree_t *trees[6];
+  for (int i = 0; i < 6; i++) {
+    trees[i] = tree_new();
+    trees[i]->score = 5.0 - i;
+  }
+
+  /* Median of the fully evaluated scores */
+  trees[0]->dominated = 1;
+  trees[0]->score = INFINITY;
+  trees[1]->score = NAN;
+  MU_CHECK(fltcmp(selection_bound(trees, 6), 2.0) == 0);
+
+  /* No bound without fully evaluated trees */
+  MU_CHECK(selection_bound(trees, 2) == INFINITY);
+
+  /* Offspring cut short by it score INFINITY and tie */
+	function_set_t *fs = setup_function_set();
+	terminal_set_t *ts = setup_terminal_set();
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+  tree_t *a = tree_generate(&rng, FULL, fs, ts, 4);
+  tree_t *b = tree_generate(&rng, FULL, fs, ts, 4);
+  evaluate_tree_bounded(a, ds, 0.0);
+  evaluate_tree_bounded(b, ds, 0.0);
+  MU_CHECK(a->dominated && a->error == INFINITY && a->score == INFINITY);
+  MU_CHECK(tree_better(a, b) == 0 && tree_better(b, a) == 0);
+
+  /* Clean up */
+  for (int i = 0; i < 6; i++) {
+    tree_delete(trees[i]);
+  }
+  tree_delete(a);
+  tree_delete(b);
+	free_function_set(fs);
+	free_terminal_set(ts);
+	dataset_delete(ds);
+
+  return 0;
+}
+
+int test_regress() {
+	/* Setup function and terminal set */
+  function_set_t *fs = setup_function_set();
+  terminal_set_t *ts = setup_terminal_set();
+
+  /* Load dataset and generate trees */
+	dataset_t *ds = dataset_load(CSV_TEST_DATA, "y");
+	int nb_trees = 1000;
+	tree_t **trees = (tree_t **) malloc(sizeof(tree_t *) * nb_trees);
+	for (int i = 0; i < nb_trees; i++) {
+    trees[i] = tree_generate(&rng, GROW, fs, ts, 3);
+	}
+
+	/* #<{(| Evaluate |)}># */
+	/* for (int i = 0; i < nb_trees; i++) { */
+	/* 	evaluate_tree(trees[i], ds); */
+	/* } */
+	/* printf("---------\n"); */
+	/* for (int i = 0; i < nb_trees; i++) { */
+	/* 	char *s = tree_string(trees[i]); */
+	/* 	printf("tree[%f]: %s\n", trees[i]->score, s); */
+	/* 	free(s); */
+	/* } */
+
+	/* tree_delete(trees[0]); */
+  /* tree_t *t = tree_new(); */
+  /* node_t *mul = node_new_func(MUL, 2); */
+  /* node_t *add = node_new_func(ADD, 2); */
+  /* node_t *hundred = node_new_const(100.0); */
+  /* node_t *x1 = node_new_input((char *) "x"); */
+  /* node_t *x2 = node_new_input((char *) "x"); */
+  /* t->root = add; */
+  /* add->children[0] = mul; */
+  /* add->children[1] = hundred; */
+  /* mul->children[0] = x1; */
+  /* mul->children[1] = x2; */
+  /* tree_update(t); */
+  /* trees[0] = t; */
+
+  int max_iter = 2000;
+  int iter = 0;
+  double max_score = INFINITY;
+  threadpool_t *pool = threadpool_new(0);
+  population_evaluate_pool(pool, trees, nb_trees, ds, max_score);
+	while (iter != max_iter) {
+
+	  /* Show the best */
+	  /* printf("---------\n"); */
+	  /* for (int i = 0; i < nb_trees; i++) { */
+    /*   char *s = tree_string(trees[i]); */
+    /*   printf("tree[%f]: %s\n", trees[i]->score, s); */
+    /*   free(s); */
+	  /* } */
+	  /* printf("---------\n"); */
+	  tree_t *best = best_tree(trees, nb_trees);
+	  char *t_str = tree_string(best);
+	  printf("iter[%d] score: %f\t error: %f [%s]\n", iter, best->score, best->error, t_str);
+	  free(t_str);
+    max_score = selection_bound(trees, nb_trees);
+
+    /* Selection, crossover and mutation, offspring are evaluated as they
+     * are bred and cut short if they cannot beat the median */
+    int t_size = nb_trees * 0.01;
+    trees = population_evolve_pool(pool, &rng, trees, nb_trees, fs, ts, ds,
+                                   t_size, 0.0, 0.2, max_score);
 
 	  iter++;
 	}
 
 	/* Clean up */
+  threadpool_delete(pool);
 	for (int i = 0; i < nb_trees; i++) {
     tree_delete(trees[i]);
   }
@@ -1160,14 +3328,23 @@ int test_regress() {
  ******************************************************************************/
 
 void test_suite() {
-  srand(time(NULL));
+  /* Fixed seed, every run draws the same trees */
+  rng_seed(&rng, 1);
 
   /* COMMON */
   MU_ADD_TEST(test_randi);
   MU_ADD_TEST(test_randf);
+  MU_ADD_TEST(test_randf_bulk);
+  MU_ADD_TEST(test_rng_split);
   MU_ADD_TEST(test_fltcmp);
   MU_ADD_TEST(test_malloc_string);
 
+  /* MEMORY */
+  MU_ADD_TEST(test_mem_alloc);
+
+  /* INPUTS */
+  MU_ADD_TEST(test_input_id);
+
   /* STACK */
   MU_ADD_TEST(test_stack_setup);
   MU_ADD_TEST(test_stack_push);
@@ -1183,11 +3360,20 @@ void test_suite() {
   MU_ADD_TEST(test_random_func);
   MU_ADD_TEST(test_random_term);
 
+  /* PROGRAM */
+  MU_ADD_TEST(test_program_compile);
+  MU_ADD_TEST(test_program_copy);
+
   /* TREE */
   MU_ADD_TEST(test_tree_new_and_delete);
   MU_ADD_TEST(test_tree_copy);
   MU_ADD_TEST(test_tree_string);
   MU_ADD_TEST(test_tree_generate);
+  MU_ADD_TEST(test_tree_compile);
+  MU_ADD_TEST(test_tree_pack);
+  MU_ADD_TEST(test_tree_splice);
+  MU_ADD_TEST(test_tree_own);
+  MU_ADD_TEST(test_tree_assign);
   MU_ADD_TEST(test_tree_update);
   MU_ADD_TEST(test_tree_get_node);
   MU_ADD_TEST(test_tree_select_rand_func);
@@ -1210,8 +3396,39 @@ void test_suite() {
   MU_ADD_TEST(test_csv_fields);
   MU_ADD_TEST(test_csv_data);
   MU_ADD_TEST(test_dataset_load_and_delete);
+  MU_ADD_TEST(test_dataset_bind);
   MU_ADD_TEST(test_evaluate_tree);
+  MU_ADD_TEST(test_evaluate_tree_operand_order);
+  MU_ADD_TEST(test_evaluate_tree_scalar_operands);
+  MU_ADD_TEST(test_eval_ctx_reserve);
+  MU_ADD_TEST(test_evaluate_tree_nested);
+  MU_ADD_TEST(test_evaluate_tree_tiled);
+  MU_ADD_TEST(test_evaluate_tree_bounded);
+  MU_ADD_TEST(test_population_evaluate);
+  MU_ADD_TEST(test_subtree_cache);
+  MU_ADD_TEST(test_population_evaluate_cached);
+  MU_ADD_TEST(test_evaluate_tree_incremental);
+  MU_ADD_TEST(test_kernels_accuracy);
+  MU_ADD_TEST(test_kernels_select);
+  MU_ADD_TEST(test_threadpool_run);
+  MU_ADD_TEST(test_threadpool_spawn);
+  MU_ADD_TEST(test_population_evaluate_pool);
+  MU_ADD_TEST(test_population_evaluate_blocks);
+  MU_ADD_TEST(test_node_cache);
+  MU_ADD_TEST(test_node_arena);
+  MU_ADD_TEST(test_population_vary);
+  MU_ADD_TEST(test_population_breed);
+  MU_ADD_TEST(test_population_evolve_pool);
+  MU_ADD_TEST(test_spsc_queue);
+  MU_ADD_TEST(test_numa);
+  MU_ADD_TEST(test_population_evaluate_replicas);
+  MU_ADD_TEST(test_islands);
+  MU_ADD_TEST(test_steady_state);
+  MU_ADD_TEST(test_steady_state_population);
+  MU_ADD_TEST(test_dataset_shm);
+  MU_ADD_TEST(test_population_evaluate_procs);
   MU_ADD_TEST(test_best_tree);
+  MU_ADD_TEST(test_selection_bound);
   MU_ADD_TEST(test_regress);
 }
 